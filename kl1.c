@@ -14,22 +14,53 @@
  * Rules with no head atoms and ruletype IMPERATIVE are interpreted as constraints (⊢ ⊥).  *
  *                                                                                         *
  * This code uses verbose variable names to highlight the semantic correspondence          *
- * with the KL1 logic formalism and is not optimized in terms of computational             *
- * cost, aiming to make the implementation didactically clear.                             *
+ * with the KL1 logic formalism, aiming to make the implementation didactically clear.     *
+ * Atoms are named by strings, interned at load time to dense integer IDs; the evaluation  *
+ * works on IDs only and names come back at print time. Models are bitsets over atom IDs,  *
+ * as wide as the vocabulary, so that membership, inclusion and equality tests are         *
+ * word-wide operations rather than scans over atom arrays.                                *
  *                                                                                         *
  * Compile with:                                                                           *
- *   gcc kl1.c -o kl1                                                                      *
+ *   gcc -O2 -pthread kl1.c -o kl1                                                         *
+ * or with make, which also provides the benchmark suite (make bench).                     *
  *                                                                                         *
  * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 /* * * * * * * * * * * * * * * * * * * * Typedef * * * * * * * * * * * * * * * * * * * * * */
 
-/* Typedef for a single atom. */
-typedef char Atom;
+/* Typedef for a single atom, as a dense ID given by a symbol table.
+ * BOTTOM stands for ⊥, the head of a constraint, and is never an ID. */
+typedef int Atom;
+#define BOTTOM ((Atom)-1)
+
+/* Typedef for a model (a set of performed acts), as a bitset with one bit
+ * per atom ID, n_words words wide. A model does not own its words, which
+ * come from new_model, an arena or a ModelSet. */
+typedef uint64_t ModelWord;
+#define MODEL_WORD_BITS 64
+
+typedef struct {
+    ModelWord *words;
+    int n_words;
+} Model;
 
 /* Typedef for a single rule. */
 typedef enum {
@@ -47,48 +78,644 @@ typedef struct {
 
 /* Typedef for a single definite clause. */
 typedef struct {
-    Atom *body;
+    const Atom *body;
     int n_atoms_in_body;
     Atom head;
 } DefiniteClause;
 
-/* Typedef for a single definite program. */
+/* Typedef for the clauses of all definite programs of a set of rules,
+ * stored once: the clauses of rule i are those with index first_clause[i]
+ * up to first_clause[i + 1] - 1. */
 typedef struct {
     DefiniteClause *clauses;
     int n_clauses;
+    int *first_clause;
+} ClausePool;
+
+/* Typedef for a single definite program, as a span of indices of
+ * clauses of a clause pool. */
+typedef struct {
+    const DefiniteClause *clauses;
+    int *clause_ids;
+    int n_clauses;
 } DefiniteProgram;
 
-/* Typedef for performed acts. */
+/* Typedef for a bump allocator: allocations are carved out of large
+ * blocks, and all of them are released at once by free_arena. */
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t used;
+    size_t size;
+    max_align_t data[];
+} ArenaBlock;
+
 typedef struct {
-    Atom *acts;
-    int n_atoms_in_performed_acts;
+    ArenaBlock *blocks;
+} Arena;
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+/* Typedef for a symbol table interning atom names to the IDs 0, 1, ...:
+ * names[a] is the name of atom a. Names are found through an
+ * open-addressing hash table (linear probing) whose slots hold IDs, or -1
+ * when empty; n_slots is a power of two. Names live in the arena. */
+typedef struct {
+    char **names;
+    int n_symbols;
     int capacity;
-} PerformedActs;
+    int *slots;
+    int n_slots;
+    Arena arena;
+} SymbolTable;
+
+/* Typedef for an arbitrary-precision natural number, used for counting
+ * programs: little-endian base-2³² limbs, without leading zero limbs. */
+typedef struct {
+    uint32_t *limbs;
+    int n_limbs;
+} BigCount;
+
+/* Largest head for which defᵣ(r), with its 2^n options, is enumerated. */
+#define MAX_ENUMERABLE_HEAD_ATOMS 24
+
+/* Typedef for a callback receiving the programs of def(R) one at a time,
+ * together with the choice vector (one index into defᵣ(rᵢ) per rule)
+ * selecting each of them. Returning false stops the enumeration. */
+typedef bool (*DefiniteProgramVisitor)(DefiniteProgram program, const int *choice, void *context);
+
+/* Typedef for a set of rules together with defᵣ(r) for each of its rules,
+ * computed once and shared by every traversal of def(R). The clause pool
+ * and the definite programs of every defᵣ(r) live in the arena. Rules are also
+ * indexed by body atom: the rules whose body contains atom a are
+ * watch_rules[watch_start[a]] .. watch_rules[watch_start[a + 1] - 1], a rule
+ * appearing once for every occurrence of a in its body.
+ * program_strides[i] is the number of programs of def(R) sharing a choice
+ * for the first i rules, so program_strides[0] = n_programs = |def(R)|;
+ * they are only meaningful if |def(R)| fits in 64 bits.
+ * is_constraint[i] tells whether rule i is a constraint (⊢ ⊥). */
+typedef struct {
+    Rule *rules;
+    int n_rules;
+    int n_atoms;
+    int n_words;
+    bool *is_constraint;
+    Arena arena;
+    ClausePool pool;
+    DefiniteProgram **defrs;
+    int *n_options;
+    int max_clauses;
+    uint64_t n_programs;
+    bool n_programs_overflows;
+    uint64_t *program_strides;
+    int *watch_start;
+    int *watch_rules;
+} CompiledRules;
+
+/* Typedef for the outcome of reducing the program space of compiled rules
+ * for a set of facts: |def(R)| and the number of options of all rules
+ * before and after, and the number of rules found dead. */
+typedef struct {
+    uint64_t n_programs_before;
+    bool n_programs_before_overflows;
+    uint64_t n_programs_after;
+    bool n_programs_after_overflows;
+    uint64_t n_options_before;
+    uint64_t n_options_after;
+    int n_dead_rules;
+} ProgramSpaceReduction;
+
+/* Typedef for the state of a depth-first search over the choices of def(R).
+ * At depth i the model is the least model of A and of the clauses chosen
+ * for the first i rules. All clauses of defᵣ(r) share the body of r, so a
+ * single counter per rule tracks how many occurrences of body atoms are
+ * still missing from the model. The trail records the atoms added, in
+ * order, and also serves as the propagation queue; backtracking pops the
+ * atoms derived by the abandoned choice and restores the counters they had
+ * decremented.
+ * A constraint is violated exactly when its counter is zero; n_violated
+ * counts such constraints, and when prune_violations is set, subtrees are
+ * abandoned as soon as it becomes positive. prefixes[i] is the index, among
+ * the nodes at depth i of the search tree, of the node being explored.
+ * A search with a deadline (in now_seconds() time, 0 for none) stops once
+ * it is over, n_nodes counting the nodes visited between clock readings;
+ * coverage is the fraction of def(R) searched, explored or pruned, when
+ * the search stopped, 1 when it ran to the end. */
+typedef struct {
+    const CompiledRules *compiled;
+    Model model;
+    int depth;
+    int n_violated;
+    bool prune_violations;
+    int *choice;
+    uint64_t *prefixes;
+    int *missing;
+    Atom *trail;
+    int n_trail;
+    int *trail_marks;
+    double deadline;
+    uint64_t n_nodes;
+    double coverage;
+} DefSearch;
+
+/* Typedef for a callback receiving each leaf of a search over def(R),
+ * together with the index of its program D in def(R): the choices making
+ * up D are search->choice, the least model M(D, A) is search->model, and D
+ * violates a constraint iff search->n_violated > 0. Returning false stops
+ * the search. */
+typedef bool (*ModelVisitor)(const DefSearch *search, uint64_t program, void *context);
+
+/* Typedef for one thread of a parallel search over def(R). The worker
+ * visits the programs whose index lies in [start, end) and publishes in
+ * next the first index it has not claimed yet. Idle workers steal the
+ * upper half of [next, end) by lowering end under the lock. */
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    uint64_t start;
+    uint64_t next;
+    uint64_t end;
+    void *context;
+    struct ParallelSearch *parallel;
+} SearchWorker;
+
+/* Typedef for the state shared by the workers of a parallel search. */
+typedef struct ParallelSearch {
+    const CompiledRules *compiled;
+    Atom *facts;
+    int n_facts;
+    bool prune_violations;
+    ModelVisitor visit;
+    SearchWorker *workers;
+    int n_workers;
+} ParallelSearch;
+
+/* Typedef for a set of distinct models kept in insertion order, the words
+ * of model j being words[j * n_words] .. words[(j + 1) * n_words - 1]. Models
+ * are found through an open-addressing hash table (linear probing) whose
+ * slots hold positions of models, or -1 when empty; n_slots is a power of
+ * two. first_programs records, for each model, the smallest index of a
+ * program of def(R) found to produce it. */
+typedef struct {
+    ModelWord *words;
+    int n_words;
+    uint64_t *first_programs;
+    size_t n_models;
+    size_t capacity;
+    ptrdiff_t *slots;
+    size_t n_slots;
+    uint64_t n_duplicates;
+} ModelSet;
+
+/* Typedef for the models of a stage spilled out of memory as sorted runs:
+ * every run is a temporary file of distinct models, n_words words each, in
+ * increasing order of their words (compare_models). The runs are merged
+ * into one before more than MAX_OPEN_RUNS are open. n_duplicates counts
+ * the duplicates dropped so far, in memory or while merging. A memory
+ * budget must leave every set room for MIN_MODELS_IN_MEMORY models. */
+#define MAX_OPEN_RUNS 64
+#define MIN_MODELS_IN_MEMORY 256
 
-/* Typedef for grouping input data (facts and rules). */
 typedef struct {
+    int n_words;
+    FILE *files[MAX_OPEN_RUNS];
+    int n_runs;
+    uint64_t n_duplicates;
+} ModelRuns;
+
+/* Typedef for the stages of a run, combined as bit flags. */
+typedef enum {
+    STAGE_DEF = 1,
+    STAGE_CNSD = 2,
+    STAGE_OUT1 = 4,
+    ALL_STAGES = STAGE_DEF | STAGE_CNSD | STAGE_OUT1
+} Stage;
+
+/* Typedef for a callback receiving the models of a stage as they are
+ * found, each one once, in the order of their first program in def(R). */
+typedef void (*NewModelVisitor)(const Model *model, void *context);
+
+/* Typedef for the bounds of a search over def(R). An anytime search stops
+ * once max_models models of its stage are found (0 for no limit), or once
+ * time_budget_ms milliseconds have passed since the search started (0 for
+ * no limit). max_memory, in bytes (0 for no bound), caps the model sets held
+ * in memory, the others being spilled to sorted runs on disk. */
+typedef struct {
+    int max_models;
+    long time_budget_ms;
+    size_t max_memory;
+} SearchBudget;
+
+/* Typedef for the state of a single pass over def(R) computing the
+ * requested stages: programs are handed to def_visit, if any, and least
+ * models are collected into cnsd and out1, the new models of stream_stage
+ * being also handed to stream_visit. The pass stops once cnsd or out1
+ * holds max_models models, unless it is 0. A set reaching
+ * max_models_in_memory models, unless it is 0, is spilled to its runs. */
+typedef struct {
+    int stages;
+    int max_models;
+    size_t max_models_in_memory;
+    DefiniteProgram program;
+    DefiniteProgramVisitor def_visit;
+    void *def_context;
+    Stage stream_stage;
+    NewModelVisitor stream_visit;
+    void *stream_context;
+    ModelSet cnsd;
+    ModelSet out1;
+    ModelRuns cnsd_runs;
+    ModelRuns out1_runs;
+} ResultsCollector;
+
+/* Typedef for grouping input data (facts and rules) with the names of their atoms. */
+typedef struct {
+    SymbolTable symbols;
     Atom *facts;
     int n_facts;
     Rule *rules;
     int n_rules;
 } KnowledgeBase;
 
-/* Typedef for grouping result sets of computations. */
+/* Typedef for the state of the parser of knowledge base files: the whole
+ * file is held in text, cursor points to the next byte to read, and line
+ * and line_start locate it for error messages, which are left in error. */
+typedef struct {
+    const char *path;
+    const char *text;
+    const char *cursor;
+    const char *end;
+    int line;
+    const char *line_start;
+    char error[256];
+} KbParser;
+
+/* Typedef for a buffered writer to a stream: bytes pile up in buffer and
+ * go out in chunks of up to WRITER_BUFFER_SIZE bytes. */
+#define WRITER_BUFFER_SIZE (1 << 20)
+
+typedef struct {
+    FILE *stream;
+    char *buffer;
+    size_t length;
+} Writer;
+
+/* Typedef for the formats of the models of a run: the sets of the human
+ * format, one model per line in the syntax of queries, or bitsets. */
+typedef enum {
+    FORMAT_HUMAN,
+    FORMAT_LINES,
+    FORMAT_BINARY
+} OutputFormat;
+
+/* Typedef for the state of writing model sets in a format, a model at a
+ * time. name_lengths caches the lengths of the atom names, extras are
+ * sorted names merged into every model, atoms is a buffer as wide as a
+ * model, and n_models counts the models of the set being written. */
 typedef struct {
-    DefiniteProgram *def_programs;
-    int n_def_programs;
-    Atom **cnsd;
-    int *cnsd_sizes;
-    int n_cnsd_models;
-    Atom **out1;
-    int *out1_sizes;
-    int n_out1_models;
+    Writer writer;
+    OutputFormat format;
+    const SymbolTable *symbols;
+    size_t *name_lengths;
+    Atom *atoms;
+    char **extras;
+    int n_extras;
+    uint64_t n_models;
+} ModelWriter;
+
+/* Typedef for the state of printing def(R) while it is enumerated. */
+typedef struct {
+    const SymbolTable *symbols;
+    Writer *writer;
+    uint64_t n_printed;
+} DefPrinter;
+
+/* Typedef for the parameters of the generator of random knowledge bases.
+ * Rules are constraints with probability constraints, and the others are
+ * permissive with probability permissive; bodies have up to body_width
+ * atoms and heads 1 to head_width atoms. The first chain_depth rules form
+ * a chain p0 ⊢ p1, ..., whose least model takes chain_depth rounds. */
+typedef struct {
+    int n_atoms;
+    int n_rules;
+    int n_facts;
+    int body_width;
+    int head_width;
+    double permissive;
+    double constraints;
+    int chain_depth;
+    uint64_t seed;
+} GeneratorSpec;
+
+/* Typedef for the engines computing cnsᵈ(R,A) and out₁(R,A): enumeration
+ * of def(R), the solver, or both, checked against each other. */
+typedef enum {
+    ENGINE_ENUMERATE,
+    ENGINE_SOLVER,
+    ENGINE_CHECK
+} Engine;
+
+/* Typedef for command-line options. */
+typedef struct {
+    int n_threads;
+    int stages;
+    bool count_only;
+    const char *input_path;
+    const char *queries_path;
+    const char *serve_path;
+    const char *client_path;
+    bool stats;
+    bool reduce;
+    bool components;
+    bool generate;
+    GeneratorSpec generator;
+    bool bench;
+    OutputFormat format;
+    Engine engine;
+    const char *credulous;
+    const char *skeptical;
+    const char *member;
+    bool minimal;
+    const char *updates_path;
+    SearchBudget budget;
+} Options;
+
+/* Typedef for grouping result sets of computations. Only the requested
+ * stages are computed; the model sets of the others are left empty.
+ * streamed is the stage whose models were streamed during the search, if
+ * any, and 0 otherwise. coverage is the fraction of def(R) searched, less
+ * than 1 when a budget cut the search short. When a stage outgrew the
+ * memory budget, its models are all in its runs, and its set is empty. */
+typedef struct {
+    uint64_t n_def_programs;
+    bool n_def_programs_overflows;
+    double coverage;
+    ModelSet cnsd;
+    ModelSet out1;
+    ModelRuns cnsd_runs;
+    ModelRuns out1_runs;
+    Stage streamed;
 } Results;
 
+/* Typedef for an independent component of R: rules sharing no atom with
+ * the rules of other components. Its rules and facts are renumbered over
+ * the atoms of the component, whose global IDs are atoms[0 .. n_atoms - 1]
+ * in increasing order. */
+typedef struct {
+    Rule *rules;
+    int n_rules;
+    Atom *atoms;
+    int n_atoms;
+    Atom *facts;
+    int n_facts;
+    CompiledRules compiled;
+    Results results;
+} Component;
+
+/* Typedef for R split into independent components, in order of their
+ * first rule. The facts of A that no rule mentions are inert: they belong
+ * to every model. */
+typedef struct {
+    Component *components;
+    int n_components;
+    Atom *inert_facts;
+    int n_inert_facts;
+} Decomposition;
+
+/* Typedef for a literal of the solver: variable v is literal 2v when it
+ * is true and 2v + 1 when it is false. */
+typedef int Literal;
+
+/* Values of the variables of the solver. */
+#define VALUE_FALSE 0
+#define VALUE_TRUE 1
+#define VALUE_UNASSIGNED 2
+
+/* Typedef for a conflict-driven clause-learning solver searching models
+ * of cnsᵈ(R,A) or out₁(R,A) directly, without going through def(R). Its
+ * variables are the atoms 0 .. n_atoms - 1, then one variable per rule
+ * body of two atoms or more, or none, standing for its conjunction;
+ * body_literals[i] is the literal holding when the body of rule i does.
+ * Clauses live in clauses (their size, then their literals) and are
+ * referred to by offset; the first two literals of a clause are watched,
+ * the clauses watching literal l being watches[l][0 .. n_watches[l] - 1].
+ * The assignment is values (per variable), with the level and the reason
+ * clause (-1 for decisions and units) of every assigned variable, and the
+ * trail of assigned literals, trail_limits[d] being where level d + 1
+ * starts. Unassigned variables are picked from a binary heap ordered by
+ * activity, with the sign they last had. While models are enumerated, the
+ * search never jumps back below backtrack_level, whose levels hold the
+ * decisions flipped once the models under them were all found (see
+ * flip_decision). The arrays have room for var_capacity variables. Rules
+ * are indexed by body atom like in CompiledRules, for checking that models
+ * are founded, and by head atom. Loop formulas only hold while loop_guard
+ * does, if it is not -1. */
+typedef struct {
+    const Rule *rules;
+    int n_rules;
+    int n_atoms;
+    int n_vars;
+    int var_capacity;
+    Literal *body_literals;
+    int *watch_start;
+    int *watch_rules;
+    int *head_start;
+    int *head_rules;
+    Literal loop_guard;
+    int *clauses;
+    size_t n_clause_ints;
+    size_t clause_capacity;
+    int **watches;
+    int *n_watches;
+    int *watch_capacity;
+    signed char *values;
+    int *levels;
+    int *reasons;
+    Literal *trail;
+    int n_trail;
+    int n_propagated;
+    int *trail_limits;
+    int n_levels;
+    int backtrack_level;
+    double *activity;
+    double activity_increment;
+    int *heap;
+    int n_heap;
+    int *heap_positions;
+    bool *phases;
+    bool *seen;
+    Literal *learnt;
+    bool unsatisfiable;
+} Solver;
+
+/* Typedef for out₁(R,A) maintained as the facts and rules of a knowledge
+ * base are added or retracted one at a time, with one solver kept across
+ * the updates. Each fact, each rule, the support clause of each atom, the
+ * loop formulas and the clauses learnt from flipped decisions during an
+ * update only hold while their selector does, a variable assumed true by
+ * every search, until it is retired by making it false for good. Facts
+ * and support clauses have their selectors per atom, rules per rule of
+ * kb, -1 where there is none; the live ones are listed in selectors. An
+ * update only searches the models it may change again, and leaves the
+ * models it added to out1 and removed from it in added and removed. */
+typedef struct {
+    KnowledgeBase *kb;
+    Solver solver;
+    Literal *fact_selectors;
+    Literal *support_selectors;
+    Literal *rule_selectors;
+    Literal search_selector;
+    Literal *selectors;
+    int n_selectors;
+    int selector_capacity;
+    size_t n_clause_ints_kept;
+    ModelSet out1;
+    ModelSet added;
+    ModelSet removed;
+} MaintainedOut1;
+
+/* Typedef for one query of batch mode: a fact set A over the atoms of R
+ * (including the facts of the knowledge base), the sorted names of its
+ * atoms unknown to R, which are inert and belong to every model, and
+ * out₁(R,A) once evaluated. line is the line of the query in its file. */
+typedef struct {
+    int line;
+    Atom *facts;
+    int n_facts;
+    char **extras;
+    int n_extras;
+    ModelSet out1;
+} Query;
+
+/* Typedef for a batch of queries shared by several threads, each thread
+ * taking the next query not taken yet. */
+typedef struct {
+    const CompiledRules *compiled;
+    Query *queries;
+    int n_queries;
+    int next_query;
+} QueryBatch;
+
+#define QUERY_BATCH_SIZE 1024
+
+/* Typedef for a reader of queries, one per line of a file. */
+typedef struct {
+    FILE *file;
+    const char *path;
+    int line;
+    char *buffer;
+    size_t capacity;
+} QueryReader;
+
+/* Typedef for a knowledge base served to clients, with its compiled rules.
+ * n_users counts the references to it: one while it is the current one,
+ * plus one per worker serving a client with it. The last user frees it. */
+typedef struct {
+    KnowledgeBase kb;
+    CompiledRules compiled;
+    int n_users;
+} ServedKnowledgeBase;
+
+/* Typedef for one thread of the server, and the search it keeps over the
+ * rules of the knowledge base it serves, restarted from every request. */
+typedef struct {
+    pthread_t thread;
+    struct Server *server;
+    int index;
+    ServedKnowledgeBase *served;
+    DefSearch search;
+} ServerWorker;
+
+/* Typedef for the state of the server. Accepted clients wait in a ring of
+ * SERVER_QUEUE_SIZE sockets until a worker takes them; client_fds[i] is
+ * the socket served by worker i, or -1. Everything but the workers is
+ * protected by lock. */
+typedef struct Server {
+    const char *socket_path;
+    int listen_fd;
+    char *kb_path;
+    ServedKnowledgeBase *current;
+    pthread_mutex_t lock;
+    pthread_cond_t queued;
+    pthread_cond_t dequeued;
+    int *queue;
+    int first_queued;
+    int n_queued;
+    int *client_fds;
+    ServerWorker *workers;
+    int n_workers;
+    bool stopping;
+} Server;
+
+#define SERVER_QUEUE_SIZE 64
+
+/* Typedef for one connection of the client, sending the requests
+ * [first, first + n_requests) and keeping the responses in output. */
+typedef struct {
+    pthread_t thread;
+    const char *socket_path;
+    char **requests;
+    int first;
+    int n_requests;
+    char *output;
+    size_t output_size;
+    bool failed;
+} ClientConnection;
+
+/* Instrumentation for --stats, compiled in with -DKL1_STATS only: without
+ * it, the STATS_ macros expand to nothing and the hot paths are unchanged. */
+#ifdef KL1_STATS
+
+/* Typedef for the timed phases of a run. */
+typedef enum {
+    TIMER_LOAD,
+    TIMER_COMPILE,
+    TIMER_SEARCH,
+    TIMER_OUTPUT,
+    N_TIMERS
+} StatsTimer;
+
+/* Typedef for the counters and timers of a run. Every thread counts in its
+ * own thread_stats, added to total_stats by flush_stats when it is done. */
+typedef struct {
+    uint64_t programs_enumerated;
+    uint64_t fixpoint_iterations;
+    uint64_t clause_evaluations;
+    uint64_t membership_tests;
+    uint64_t dedup_comparisons;
+    uint64_t duplicates_found;
+    uint64_t models_rejected;
+    uint64_t subtrees_pruned;
+    uint64_t bytes_allocated;
+    uint64_t solver_decisions;
+    uint64_t solver_conflicts;
+    uint64_t loop_formulas;
+    uint64_t models_spilled;
+    double seconds[N_TIMERS];
+} Stats;
+
+__thread Stats thread_stats;
+Stats total_stats;
+pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define STATS_ADD(counter, n) (thread_stats.counter += (n))
+#define STATS_START(timer) double timer = now_seconds()
+#define STATS_STOP(phase, timer) (thread_stats.seconds[phase] += now_seconds() - (timer))
+#define STATS_FLUSH() flush_stats()
+
+#else
+
+#define STATS_ADD(counter, n) ((void)0)
+#define STATS_START(timer) ((void)0)
+#define STATS_STOP(phase, timer) ((void)0)
+#define STATS_FLUSH() ((void)0)
+
+#endif
+
 /* * * * * * * * * * * * * * * * * * * * Utils * * * * * * * * * * * * * * * * * * * * * * */
 
 /* Safe malloc. */
 void *safe_malloc(size_t size) {
+    STATS_ADD(bytes_allocated, size);
     void *ptr = malloc(size);
     if (!ptr) {
         perror("Malloc failed!");
@@ -99,6 +726,7 @@ void *safe_malloc(size_t size) {
 
 /* Safe realloc. */
 void *safe_realloc(void *ptr, size_t size) {
+    STATS_ADD(bytes_allocated, size);
     void *new_ptr = realloc(ptr, size);
     if (!new_ptr) {
         perror("Realloc failed!");
@@ -107,617 +735,5821 @@ void *safe_realloc(void *ptr, size_t size) {
     return new_ptr;
 }
 
-/* Function for initializing performed acts. */
-void init_performed_acts(PerformedActs *acts) {
-    acts->n_atoms_in_performed_acts = 0;
-    acts->capacity = 4;
-    acts->acts = safe_malloc(acts->capacity * sizeof(Atom));
+/* Function for reading a monotonic clock, in seconds. */
+double now_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
 }
 
-/* Function for adding an atom to performed acts. */
-void push_atom_to_performed_acts(PerformedActs *acts, Atom a) {
-    if (acts->n_atoms_in_performed_acts == acts->capacity) {
-        acts->capacity *= 2;
-        acts->acts = safe_realloc(acts->acts, acts->capacity * sizeof(Atom));
+#ifdef KL1_STATS
+/* Function for adding the counters and timers of the calling thread to the
+ * totals, and clearing them. */
+void flush_stats(void) {
+    pthread_mutex_lock(&stats_lock);
+    total_stats.programs_enumerated += thread_stats.programs_enumerated;
+    total_stats.fixpoint_iterations += thread_stats.fixpoint_iterations;
+    total_stats.clause_evaluations += thread_stats.clause_evaluations;
+    total_stats.membership_tests += thread_stats.membership_tests;
+    total_stats.dedup_comparisons += thread_stats.dedup_comparisons;
+    total_stats.duplicates_found += thread_stats.duplicates_found;
+    total_stats.models_rejected += thread_stats.models_rejected;
+    total_stats.subtrees_pruned += thread_stats.subtrees_pruned;
+    total_stats.bytes_allocated += thread_stats.bytes_allocated;
+    total_stats.solver_decisions += thread_stats.solver_decisions;
+    total_stats.solver_conflicts += thread_stats.solver_conflicts;
+    total_stats.loop_formulas += thread_stats.loop_formulas;
+    total_stats.models_spilled += thread_stats.models_spilled;
+    for (int t = 0; t < N_TIMERS; t++) {
+        total_stats.seconds[t] += thread_stats.seconds[t];
     }
-    acts->acts[acts->n_atoms_in_performed_acts++] = a;
+    pthread_mutex_unlock(&stats_lock);
+    memset(&thread_stats, 0, sizeof(thread_stats));
 }
+#endif
 
-/* * * * * * * * * * * * * * * * * * * Computation * * * * * * * * * * * * * * * * * * * * */
+/* Function for drawing the next number of a seeded pseudo-random sequence
+ * (splitmix64), the same on every platform. */
+uint64_t next_random(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
 
-/* Encode a rule given body, head, and rule type.
- * Allocate and copy both body and head into the rule structure.
- */
-Rule encode_rule(int n_body, int n_head, Atom *body, Atom *head, RuleType ruletype) {
-    Rule r;
-    
-    /* Copy body */
-    r.n_atoms_in_body = n_body;
-    r.body = safe_malloc(n_body * sizeof(Atom));
-    for (int i = 0; i < n_body; i++) {
-        r.body[i] = body[i];
-    }
-    
-    /* Copy head or set ⊥ for constraint */
-    if (n_head == 0) {
-        r.n_atoms_in_head = 1;
-        r.head = safe_malloc(sizeof(Atom));
-        
-        /* Special char meaning ⊥. */
-        r.head[0] = '/'; 
-    } else {
-        r.n_atoms_in_head = n_head;
-        r.head = safe_malloc(n_head * sizeof(Atom));
-        for (int i = 0; i < n_head; i++) {
-            r.head[i] = head[i];
-        }
-    }
-    r.ruletype = ruletype;
-    return r;
+/* Function for drawing a pseudo-random integer in [0, n). */
+int random_below(uint64_t *state, int n) {
+    return (int)(next_random(state) % (uint64_t)n);
 }
 
-/* Function for computing defᵣ for a given rule. */
-DefiniteProgram *defr(Rule rule, int *n_definite_programs) {
-    int n_atoms_in_head = rule.n_atoms_in_head;
-    
-    /* Void head. */
-    if (n_atoms_in_head == 0) {
-        DefiniteProgram *defr = safe_malloc(sizeof(DefiniteProgram));
-        defr[0].n_clauses = 1;
-        defr[0].clauses = safe_malloc(sizeof(DefiniteClause));
-        defr[0].clauses[0].head = '/';
-        defr[0].clauses[0].n_atoms_in_body = rule.n_atoms_in_body;
-        defr[0].clauses[0].body = safe_malloc(rule.n_atoms_in_body * sizeof(Atom));
-        for (int i = 0; i < rule.n_atoms_in_body; i++) {
-            defr[0].clauses[0].body[i] = rule.body[i];
-        }
-        *n_definite_programs = 1;
-        return defr;
-    }
-    
-    /* 2^n possible subsets of head (C). */
-    int total_subsets = 1 << n_atoms_in_head;
-    DefiniteProgram *defr = safe_malloc(total_subsets * sizeof(DefiniteProgram));
-    int n_definite_programs_generated = 0;
-    
-    /* Cycle through all possible binary masks i.e., all subsets of head atoms. */
-    for (int bitmask = 0; bitmask < total_subsets; bitmask++) {
-        int clause_count = 0;
-        
-        /* Count how many atoms are in this subset (bitmask). */
-        for (int i = 0; i < n_atoms_in_head; i++) {
-            if (bitmask & (1 << i)) clause_count++;
-        }
-        
-        /* If void subset and rule is imperative, skip (constraint cannot be empty for ⊢). */
-        if (clause_count == 0 && rule.ruletype == IMPERATIVE) continue;
-        
-        /* If void subset and rule is permissive, add an empty program. */
-        if (clause_count == 0 && rule.ruletype == PERMISSIVE) {
-            defr[n_definite_programs_generated].n_clauses = 0;
-            defr[n_definite_programs_generated].clauses = NULL;
-            n_definite_programs_generated++;
-            continue;
-        }
-        defr[n_definite_programs_generated].n_clauses = clause_count;
-        
-        /* Allocate the right number of clauses in defr. */
-        defr[n_definite_programs_generated].clauses = safe_malloc(clause_count * sizeof(DefiniteClause));
-        
-        /* For each selected atom in bitmask, create a clause in the definite program. */
-        int clause_index = 0;
-        for (int i = 0; i < n_atoms_in_head; i++) {
-            if (bitmask & (1 << i)) {
-                defr[n_definite_programs_generated].clauses[clause_index].head = rule.head[i];
-                defr[n_definite_programs_generated].clauses[clause_index].n_atoms_in_body = rule.n_atoms_in_body;
-                defr[n_definite_programs_generated].clauses[clause_index].body = safe_malloc(rule.n_atoms_in_body * sizeof(Atom));
-                for (int j = 0; j < rule.n_atoms_in_body; j++) {
-                    defr[n_definite_programs_generated].clauses[clause_index].body[j] = rule.body[j];
-                }
-                clause_index++;
-            }
-        }
-        n_definite_programs_generated++;
-    }
-    *n_definite_programs = n_definite_programs_generated;
-    return defr;
+/* Function for drawing a pseudo-random real in [0, 1). */
+double random_unit(uint64_t *state) {
+    return (next_random(state) >> 11) * (1.0 / 9007199254740992.0);
 }
 
-/* Function for translating a set of rules into a set of 
- * definite programs, namely def(R). */
-DefiniteProgram *defR(Rule *rules, int n_rules, int *n_total_programs) {
-    
-    /* Compute defᵣ(r) for each rule and count options per rule. */
-    int *n_options = safe_malloc(n_rules * sizeof(int));
-    DefiniteProgram **defrs = safe_malloc(n_rules * sizeof(DefiniteProgram *));
-    for (int i = 0; i < n_rules; i++) {
-        defrs[i] = defr(rules[i], &n_options[i]);
-    }
-    
-    /* Compute total number of definite programs in def(R). */
-    int total = 1;
-    for (int i = 0; i < n_rules; i++) {
-        total *= n_options[i];
-    }
-    *n_total_programs = total;
-    DefiniteProgram *all_programs = safe_malloc(total * sizeof(DefiniteProgram));
-    
-    /* Cycle through all combinations of choices (one from each defᵣ(rᵢ)). */
-    for (int p = 0; p < total; p++) {
-        int *choice = safe_malloc(n_rules * sizeof(int));
-        int quotient = p;
-        for (int i = n_rules - 1; i >= 0; i--) {
-            choice[i] = quotient % n_options[i];
-            quotient /= n_options[i];
-        }
-        
-        /* Combine chosen clauses from each rule to form one definite program. */
-        int total_clauses = 0;
-        for (int i = 0; i < n_rules; i++) {
-            total_clauses += defrs[i][choice[i]].n_clauses;
-        }
-        all_programs[p].n_clauses = total_clauses;
-        all_programs[p].clauses = safe_malloc(total_clauses * sizeof(DefiniteClause));
-        
-        /* Copy clauses from each selected definite program into all_programs[p]. */
-        int idx = 0;
-        for (int i = 0; i < n_rules; i++) {
-            DefiniteProgram selected = defrs[i][choice[i]];
-            for (int j = 0; j < selected.n_clauses; j++) {
-                all_programs[p].clauses[idx].n_atoms_in_body = selected.clauses[j].n_atoms_in_body;
-                all_programs[p].clauses[idx].body = safe_malloc(selected.clauses[j].n_atoms_in_body * sizeof(Atom));
-                for (int k = 0; k < selected.clauses[j].n_atoms_in_body; k++) {
-                    all_programs[p].clauses[idx].body[k] = selected.clauses[j].body[k];
-                }
-                all_programs[p].clauses[idx].head = selected.clauses[j].head;
-                idx++;
-            }
-        }
-        free(choice);
-    }
-    for (int i = 0; i < n_rules; i++) free(defrs[i]);
-    free(defrs);
-    free(n_options);
-    return all_programs;
+/* Function for the number of words of a model over n_atoms atoms. */
+int model_words_for(int n_atoms) {
+    return n_atoms > 0 ? (n_atoms + MODEL_WORD_BITS - 1) / MODEL_WORD_BITS : 1;
 }
 
-/* Compute the least model of a definite program D given
- * an initial set of facts A. This is a fixed-point computation:
- * at each step, we add to the model all heads of clauses whose
- * bodies are satisfied by the current model.
- */
-Atom *least_model(DefiniteProgram D, Atom *facts, int n_facts, int *out_size) {
-    PerformedActs M;
-    init_performed_acts(&M);
-    
-    /* M0(D, A) = A */
-    for (int i = 0; i < n_facts; i++) {
-        push_atom_to_performed_acts(&M, facts[i]);
-    }
-    bool changed = true;
-    while (changed) {
-        changed = false;
-        for (int i = 0; i < D.n_clauses; i++) {
+/* Function for emptying a model. */
+void model_clear(Model *m) {
+    memset(m->words, 0, m->n_words * sizeof(ModelWord));
+}
 
-            /* Skip constraints (head = ⊥). */
-            if (D.clauses[i].head == '/') continue; 
-            
-            /* Check if all atoms in the clause's body are already in M. */
-            bool body_ok = true;
-            for (int j = 0; j < D.clauses[i].n_atoms_in_body; j++) {
-                Atom a = D.clauses[i].body[j];
-                bool found = false;
-                for (int k = 0; k < M.n_atoms_in_performed_acts; k++) {
-                    if (M.acts[k] == a) {
-                        found = true;
-                        break;
-                    }
-                }
-                if (!found) {
-                    body_ok = false;
-                    break;
-                }
-            }
-            
-            /* If body is satisfied and head not already in M, add it. */
-            if (body_ok) {
-                Atom h = D.clauses[i].head;
-                bool in_M = false;
-                for (int k = 0; k < M.n_atoms_in_performed_acts; k++) {
-                    if (M.acts[k] == h) {
-                        in_M = true;
-                        break;
-                    }
-                }
-                if (!in_M) {
-                    push_atom_to_performed_acts(&M, h);
-                    changed = true;
-                }
-            }
-        }
-    }
-    *out_size = M.n_atoms_in_performed_acts;
-    return M.acts;
+/* Function for allocating an empty model n_words wide. */
+Model new_model(int n_words) {
+    Model m;
+    m.n_words = n_words;
+    m.words = safe_malloc(n_words * sizeof(ModelWord));
+    model_clear(&m);
+    return m;
 }
 
-/* Function for computing cnsᵈ(R, A). */
-Atom **cns_star(Rule *R, int n_rules, Atom *A, int n_facts, int *n_out_models, int **model_sizes) {
-    int n_total_programs;
-    DefiniteProgram *def = defR(R, n_rules, &n_total_programs);
-    Atom **cnsd = safe_malloc(n_total_programs * sizeof(Atom *));
-    *model_sizes = safe_malloc(n_total_programs * sizeof(int));
-    *n_out_models = 0;
-    for (int i = 0; i < n_total_programs; i++) {
-        int model_size;
-        Atom *model = least_model(def[i], A, n_facts, &model_size);
-        
-        /* Check for duplicates before adding the model to cnsd. */
-        int duplicate = 0;
-        for (int j = 0; j < *n_out_models; j++) {
-            if (model_size != (*model_sizes)[j]) continue;
-            int equal = 1;
-            for (int k = 0; k < model_size; k++) {
-                int found = 0;
-                for (int l = 0; l < model_size; l++) {
-                    if (model[k] == cnsd[j][l]) {
-                        found = 1;
-                        break;
-                    }
-                }
-                if (!found) {
-                    equal = 0;
-                    break;
-                }
-            }
-            if (equal) {
-                duplicate = 1;
-                break;
-            }
-        }
-        if (!duplicate) {
-            cnsd[*n_out_models] = model;
-            (*model_sizes)[*n_out_models] = model_size;
-            (*n_out_models)++;
-        } else {
-            free(model);
-        }
-    }
-    free(def);
-    return cnsd;
+/* Free the words of a model allocated by new_model. */
+void free_model(Model *m) {
+    free(m->words);
 }
 
-/* Function for checking if a model satisfies all constraints in R. */
-bool satisfies_constraints(Rule *R, int n_rules, Atom *model, int model_size) {
-    for (int i = 0; i < n_rules; i++) {
-        Rule r = R[i];
-        if (r.ruletype == IMPERATIVE &&
-            r.n_atoms_in_head == 1 &&
-            r.head[0] == '/') {
-            
-            /* Constraint (⊢ ⊥): the rule's body must *not* be fully satisfied by the model. */
-            bool violated = true;
-            for (int j = 0; j < r.n_atoms_in_body; j++) {
-                Atom a = r.body[j];
-                bool found = false;
-                for (int k = 0; k < model_size; k++) {
-                    if (model[k] == a) {
-                        found = true;
-                        break;
-                    }
-                }
-                if (!found) {
-                    violated = false;
-                    break;
-                }
-            }
-            
-            /* If constraint is violated (body satisfied => ⊥), model is not valid. */
-            if (violated) return false;
-        }
-    }
+/* Function for adding an atom to a model. */
+void model_add(Model *m, Atom a) {
+    m->words[a / MODEL_WORD_BITS] |= (ModelWord)1 << (a % MODEL_WORD_BITS);
+}
 
-    /* All constraints satisfied. */
-    return true;
+/* Function for checking whether an atom belongs to a model. */
+bool model_contains(const Model *m, Atom a) {
+    STATS_ADD(membership_tests, 1);
+    return (m->words[a / MODEL_WORD_BITS] >> (a % MODEL_WORD_BITS)) & 1;
 }
 
-/* Function for computing out₁(R, A). */
-Atom **out(Rule *R, int n_rules, Atom *A, int n_facts, int *n_models, int **model_sizes) {
-    
-    /* Compute all models M(D, A) for each definite program D in def(R). */
-    int total;
-    int *sizes;
-    Atom **cnsd = cns_star(R, n_rules, A, n_facts, &total, &sizes);
-    
-    /* Filter out models that violate any constraints in R. */
-    Atom **out1 = safe_malloc(total * sizeof(Atom *));
-    *model_sizes = safe_malloc(total * sizeof(int));
-    *n_models = 0;
-    for (int i = 0; i < total; i++) {
-        if (satisfies_constraints(R, n_rules, cnsd[i], sizes[i])) {
-            out1[*n_models] = cnsd[i];
-            (*model_sizes)[*n_models] = sizes[i];
-            (*n_models)++;
-        } else {
-            free(cnsd[i]);
-        }
+/* Function for checking whether every atom of subset also belongs to m. */
+bool model_includes(const Model *m, const Model *subset) {
+    for (int w = 0; w < m->n_words; w++) {
+        if (subset->words[w] & ~m->words[w]) return false;
     }
-    free(cnsd);
-    free(sizes);
-    return out1;
+    return true;
 }
 
-/* * * * * * * * * * * * * * * * * * * * I/O * * * * * * * * * * * * * * * * * * * * * */
+/* Function for removing an atom from a model. */
+void model_remove(Model *m, Atom a) {
+    m->words[a / MODEL_WORD_BITS] &= ~((ModelWord)1 << (a % MODEL_WORD_BITS));
+}
 
-/* Function for printing a set of atoms. */
-void print_atoms(Atom facts[], int n_atoms_in_facts) {
-    printf("A: \n");
-    for (int i = 0; i < n_atoms_in_facts; i++) {
-        printf("%c", facts[i]);
-        if (i < n_atoms_in_facts - 1) printf(", ");
-    }
-    printf("\n\n");
+/* Function for checking whether two models of the same width contain the same atoms. */
+bool model_equal(const Model *a, const Model *b) {
+    return memcmp(a->words, b->words, a->n_words * sizeof(ModelWord)) == 0;
 }
 
-/* Function for printing a single rule. */
-void print_rule(Rule r) {
-    for (int i = 0; i < r.n_atoms_in_body; i++) {
-        printf("%c", r.body[i]);
-        if (i < r.n_atoms_in_body - 1) printf(" ∧ ");
-    }
-    if (r.ruletype == IMPERATIVE) {
-        printf(" ⊢ ");
-    } else {
-        printf(" ⊣ ");
-    }
-    if (r.head[0] == '/') {
-        printf("⊥");
-    } else {
-        for (int i = 0; i < r.n_atoms_in_head; i++) {
-            printf("%c", r.head[i]);
-            if (i < r.n_atoms_in_head - 1) printf(" ∨ ");
+/* Function for listing the atoms of a model in increasing order.
+ * atoms must have room for n_words * MODEL_WORD_BITS atoms. Returns their number. */
+int model_atoms(const Model *m, Atom *atoms) {
+    int n_atoms = 0;
+    for (int w = 0; w < m->n_words; w++) {
+        ModelWord bits = m->words[w];
+        while (bits) {
+            atoms[n_atoms++] = (Atom)(w * MODEL_WORD_BITS + __builtin_ctzll(bits));
+            bits &= bits - 1;
         }
     }
+    return n_atoms;
 }
 
-/* Function for printing a single definite clause (with optional trailing comma). */
-void print_definite_clause(DefiniteClause c, int with_comma) {
-    if (c.head == '/') {
-        printf("⊥ ← ");
-    } else {
-        printf("%c ← ", c.head);
-    }
-    if (c.n_atoms_in_body == 0) {
-        printf("{}");
-    } else {
-        printf("{");
-        for (int i = 0; i < c.n_atoms_in_body; i++) {
-            printf("%c", c.body[i]);
-            if (i < c.n_atoms_in_body - 1) printf(", ");
-        }
-        printf("}");
+/* Function for setting a model to the atoms of an array. */
+void model_set_atoms(Model *m, const Atom *atoms, int n_atoms) {
+    model_clear(m);
+    for (int i = 0; i < n_atoms; i++) {
+        model_add(m, atoms[i]);
     }
-    if (with_comma) printf(", ");
 }
 
-/* Function for printing a single definite program. */
-void print_definite_program(DefiniteProgram prog) {
-    printf("{");
-    for (int j = 0; j < prog.n_clauses; j++) {
-        print_definite_clause(prog.clauses[j], j < prog.n_clauses - 1);
+/* Function for allocating size bytes from an arena. */
+void *arena_alloc(Arena *arena, size_t size) {
+    size = (size + sizeof(max_align_t) - 1) / sizeof(max_align_t) * sizeof(max_align_t);
+    ArenaBlock *block = arena->blocks;
+    if (!block || block->size - block->used < size) {
+        size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        block = safe_malloc(sizeof(ArenaBlock) + block_size);
+        block->used = 0;
+        block->size = block_size;
+        block->next = arena->blocks;
+        arena->blocks = block;
     }
-    printf("}");
+    void *ptr = (unsigned char *)block->data + block->used;
+    block->used += size;
+    return ptr;
+}
+
+/* Free all allocations of an arena at once. */
+void free_arena(Arena *arena) {
+    while (arena->blocks) {
+        ArenaBlock *next = arena->blocks->next;
+        free(arena->blocks);
+        arena->blocks = next;
+    }
+}
+
+/* Function for hashing an atom name of the given length (FNV-1a). */
+uint64_t name_hash(const char *name, size_t length) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < length; i++) {
+        h ^= (unsigned char)name[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+/* Function for initializing an empty symbol table. */
+void init_symbol_table(SymbolTable *symbols) {
+    symbols->n_symbols = 0;
+    symbols->capacity = 16;
+    symbols->names = safe_malloc(symbols->capacity * sizeof(char *));
+    symbols->n_slots = 32;
+    symbols->slots = safe_malloc(symbols->n_slots * sizeof(int));
+    for (int i = 0; i < symbols->n_slots; i++) symbols->slots[i] = -1;
+    symbols->arena.blocks = NULL;
+}
+
+/* Free a symbol table and the names it holds. */
+void free_symbol_table(SymbolTable *symbols) {
+    free(symbols->names);
+    free(symbols->slots);
+    free_arena(&symbols->arena);
+}
+
+/* Function for rebuilding the hash table of a symbol table with n_slots slots. */
+void rehash_symbol_table(SymbolTable *symbols, int n_slots) {
+    free(symbols->slots);
+    symbols->n_slots = n_slots;
+    symbols->slots = safe_malloc(symbols->n_slots * sizeof(int));
+    for (int i = 0; i < symbols->n_slots; i++) symbols->slots[i] = -1;
+    for (int a = 0; a < symbols->n_symbols; a++) {
+        size_t slot = name_hash(symbols->names[a], strlen(symbols->names[a])) & (symbols->n_slots - 1);
+        while (symbols->slots[slot] != -1) slot = (slot + 1) & (symbols->n_slots - 1);
+        symbols->slots[slot] = a;
+    }
+}
+
+/* Function for finding the slot of a name (length bytes, not necessarily
+ * NUL-terminated) in a symbol table: the slot holding its ID, or the empty
+ * slot where it would go. */
+size_t find_symbol_slot(const SymbolTable *symbols, const char *name, size_t length) {
+    size_t slot = name_hash(name, length) & (symbols->n_slots - 1);
+    while (symbols->slots[slot] != -1) {
+        const char *candidate = symbols->names[symbols->slots[slot]];
+        if (strncmp(candidate, name, length) == 0 && candidate[length] == '\0') break;
+        slot = (slot + 1) & (symbols->n_slots - 1);
+    }
+    return slot;
+}
+
+/* Function for finding the ID of an atom name. Returns -1 if the name was never interned. */
+Atom find_atom(const SymbolTable *symbols, const char *name, size_t length) {
+    return symbols->slots[find_symbol_slot(symbols, name, length)];
+}
+
+/* Function for interning an atom name: returns its ID, giving it the next
+ * free ID the first time it is seen. */
+Atom intern_atom(SymbolTable *symbols, const char *name, size_t length) {
+    size_t slot = find_symbol_slot(symbols, name, length);
+    if (symbols->slots[slot] != -1) return symbols->slots[slot];
+    if (symbols->n_symbols == symbols->capacity) {
+        symbols->capacity *= 2;
+        symbols->names = safe_realloc(symbols->names, symbols->capacity * sizeof(char *));
+    }
+    char *copy = arena_alloc(&symbols->arena, length + 1);
+    memcpy(copy, name, length);
+    copy[length] = '\0';
+    Atom a = symbols->n_symbols++;
+    symbols->names[a] = copy;
+    symbols->slots[slot] = a;
+    
+    /* Keep the load factor at most 1/2. */
+    if (2 * symbols->n_symbols > symbols->n_slots) rehash_symbol_table(symbols, 2 * symbols->n_slots);
+    return a;
+}
+
+/* Function for the name of an atom (⊥ for BOTTOM). */
+const char *atom_name(const SymbolTable *symbols, Atom a) {
+    return a == BOTTOM ? "⊥" : symbols->names[a];
+}
+
+/* Comparator ordering atom names alphabetically. */
+int compare_names(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* Function for renumbering the atoms of a symbol table in alphabetical
+ * order of their names, so that IDs do not depend on the order in which
+ * names were first seen. renumber[a] receives the new ID of atom a. */
+void sort_symbol_table(SymbolTable *symbols, Atom *renumber) {
+    char **names = safe_malloc((symbols->n_symbols > 0 ? symbols->n_symbols : 1) * sizeof(char *));
+    memcpy(names, symbols->names, symbols->n_symbols * sizeof(char *));
+    qsort(names, symbols->n_symbols, sizeof(char *), compare_names);
+    for (int a = 0; a < symbols->n_symbols; a++) {
+        renumber[find_atom(symbols, names[a], strlen(names[a]))] = a;
+    }
+    free(symbols->names);
+    symbols->names = names;
+    symbols->capacity = symbols->n_symbols > 0 ? symbols->n_symbols : 1;
+    rehash_symbol_table(symbols, symbols->n_slots);
+}
+
+/* Function for initializing a BigCount to a 64-bit value. */
+void init_bigcount(BigCount *count, uint64_t value) {
+    count->limbs = safe_malloc(2 * sizeof(uint32_t));
+    count->limbs[0] = (uint32_t)value;
+    count->limbs[1] = (uint32_t)(value >> 32);
+    count->n_limbs = count->limbs[1] ? 2 : (count->limbs[0] ? 1 : 0);
+}
+
+/* Free the limbs of a BigCount. */
+void free_bigcount(BigCount *count) {
+    free(count->limbs);
+}
+
+/* Function for multiplying a BigCount by 2^bits. */
+void bigcount_shift_left(BigCount *count, int bits) {
+    if (count->n_limbs == 0) return;
+    int limb_shift = bits / 32, bit_shift = bits % 32;
+    int n_limbs = count->n_limbs + limb_shift + 1;
+    uint32_t *limbs = safe_malloc(n_limbs * sizeof(uint32_t));
+    memset(limbs, 0, n_limbs * sizeof(uint32_t));
+    for (int i = 0; i < count->n_limbs; i++) {
+        uint64_t shifted = (uint64_t)count->limbs[i] << bit_shift;
+        limbs[i + limb_shift] |= (uint32_t)shifted;
+        limbs[i + limb_shift + 1] |= (uint32_t)(shifted >> 32);
+    }
+    free(count->limbs);
+    count->limbs = limbs;
+    count->n_limbs = n_limbs;
+    while (count->n_limbs > 0 && count->limbs[count->n_limbs - 1] == 0) count->n_limbs--;
+}
+
+/* Function for multiplying a BigCount by a 32-bit factor. */
+void bigcount_multiply(BigCount *count, uint32_t factor) {
+    uint64_t carry = 0;
+    for (int i = 0; i < count->n_limbs; i++) {
+        uint64_t product = (uint64_t)count->limbs[i] * factor + carry;
+        count->limbs[i] = (uint32_t)product;
+        carry = product >> 32;
+    }
+    if (carry) {
+        count->limbs = safe_realloc(count->limbs, (count->n_limbs + 1) * sizeof(uint32_t));
+        count->limbs[count->n_limbs++] = (uint32_t)carry;
+    }
+    while (count->n_limbs > 0 && count->limbs[count->n_limbs - 1] == 0) count->n_limbs--;
+}
+
+/* Function for subtracting b from a, which must not be smaller than b. */
+void bigcount_subtract(BigCount *a, const BigCount *b) {
+    int64_t borrow = 0;
+    for (int i = 0; i < a->n_limbs; i++) {
+        int64_t difference = (int64_t)a->limbs[i] - (i < b->n_limbs ? b->limbs[i] : 0) - borrow;
+        borrow = difference < 0;
+        a->limbs[i] = (uint32_t)(difference + (borrow ? ((int64_t)1 << 32) : 0));
+    }
+    while (a->n_limbs > 0 && a->limbs[a->n_limbs - 1] == 0) a->n_limbs--;
+}
+
+/* Function for writing a BigCount in decimal. Returns a string to be freed. */
+char *bigcount_to_string(const BigCount *count) {
+    
+    /* Each limb takes at most 10 decimal digits. */
+    char *digits = safe_malloc(10 * count->n_limbs + 10);
+    uint32_t *limbs = safe_malloc((count->n_limbs > 0 ? count->n_limbs : 1) * sizeof(uint32_t));
+    memcpy(limbs, count->limbs, count->n_limbs * sizeof(uint32_t));
+    int n_limbs = count->n_limbs, n_digits = 0;
+    do {
+        
+        /* Divide by 10^9 in place, the remainder giving the next 9 digits. */
+        uint64_t remainder = 0;
+        for (int i = n_limbs - 1; i >= 0; i--) {
+            uint64_t current = (remainder << 32) | limbs[i];
+            limbs[i] = (uint32_t)(current / 1000000000);
+            remainder = current % 1000000000;
+        }
+        while (n_limbs > 0 && limbs[n_limbs - 1] == 0) n_limbs--;
+        for (int k = 0; k < 9 && (n_limbs > 0 || remainder > 0 || k == 0); k++) {
+            digits[n_digits++] = (char)('0' + remainder % 10);
+            remainder /= 10;
+        }
+    } while (n_limbs > 0);
+    digits[n_digits] = '\0';
+    for (int i = 0; i < n_digits / 2; i++) {
+        char digit = digits[i];
+        digits[i] = digits[n_digits - 1 - i];
+        digits[n_digits - 1 - i] = digit;
+    }
+    free(limbs);
+    return digits;
+}
+
+/* Function for hashing a model, mixing its words. */
+uint64_t model_hash(const Model *m) {
+    uint64_t h = 0x9e3779b97f4a7c15ULL;
+    for (int w = 0; w < m->n_words; w++) {
+        h ^= m->words[w];
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
+    }
+    return h;
+}
+
+/* Function for initializing an empty set of models n_words wide. */
+void init_model_set(ModelSet *set, int n_words) {
+    set->n_words = n_words;
+    set->n_models = 0;
+    set->capacity = 4;
+    set->words = safe_malloc(set->capacity * n_words * sizeof(ModelWord));
+    set->first_programs = safe_malloc(set->capacity * sizeof(uint64_t));
+    set->n_slots = 8;
+    set->slots = safe_malloc(set->n_slots * sizeof(ptrdiff_t));
+    for (size_t i = 0; i < set->n_slots; i++) set->slots[i] = -1;
+    set->n_duplicates = 0;
+}
+
+/* Free a set of models. */
+void free_model_set(ModelSet *set) {
+    free(set->words);
+    free(set->first_programs);
+    free(set->slots);
+}
+
+/* Function for the model at position j of a set of models. */
+Model model_set_at(const ModelSet *set, size_t j) {
+    Model m;
+    m.words = set->words + j * set->n_words;
+    m.n_words = set->n_words;
+    return m;
+}
+
+/* Function for rebuilding the hash table of a set of models with n_slots slots. */
+void rehash_model_set(ModelSet *set, size_t n_slots) {
+    free(set->slots);
+    set->n_slots = n_slots;
+    set->slots = safe_malloc(set->n_slots * sizeof(ptrdiff_t));
+    for (size_t i = 0; i < set->n_slots; i++) set->slots[i] = -1;
+    for (size_t j = 0; j < set->n_models; j++) {
+        Model m = model_set_at(set, j);
+        size_t slot = model_hash(&m) & (set->n_slots - 1);
+        while (set->slots[slot] != -1) slot = (slot + 1) & (set->n_slots - 1);
+        set->slots[slot] = (ptrdiff_t)j;
+    }
+}
+
+/* Function for adding a model, produced by the program of def(R) with the
+ * given index, to a set of models.
+ * Returns false (and counts a duplicate) if the model was already there. */
+bool model_set_insert(ModelSet *set, const Model *m, uint64_t program) {
+    size_t slot = model_hash(m) & (set->n_slots - 1);
+    while (set->slots[slot] != -1) {
+        size_t j = (size_t)set->slots[slot];
+        Model model = model_set_at(set, j);
+        STATS_ADD(dedup_comparisons, 1);
+        if (model_equal(m, &model)) {
+            if (program < set->first_programs[j]) set->first_programs[j] = program;
+            set->n_duplicates++;
+            STATS_ADD(duplicates_found, 1);
+            return false;
+        }
+        slot = (slot + 1) & (set->n_slots - 1);
+    }
+    if (set->n_models == set->capacity) {
+        set->capacity *= 2;
+        set->words = safe_realloc(set->words, set->capacity * set->n_words * sizeof(ModelWord));
+        set->first_programs = safe_realloc(set->first_programs, set->capacity * sizeof(uint64_t));
+    }
+    memcpy(set->words + set->n_models * set->n_words, m->words, set->n_words * sizeof(ModelWord));
+    set->first_programs[set->n_models] = program;
+    set->slots[slot] = (ptrdiff_t)set->n_models++;
+    
+    /* Keep the load factor at most 1/2. */
+    if (2 * set->n_models > set->n_slots) rehash_model_set(set, 2 * set->n_slots);
+    return true;
+}
+
+/* Function for the position of a model in a set of models, or -1. */
+ptrdiff_t model_set_find(const ModelSet *set, const Model *m) {
+    size_t slot = model_hash(m) & (set->n_slots - 1);
+    while (set->slots[slot] != -1) {
+        Model model = model_set_at(set, (size_t)set->slots[slot]);
+        if (model_equal(m, &model)) return set->slots[slot];
+        slot = (slot + 1) & (set->n_slots - 1);
+    }
+    return -1;
+}
+
+/* Function for checking whether a set contains a model. */
+bool model_set_contains(const ModelSet *set, const Model *m) {
+    return model_set_find(set, m) >= 0;
+}
+
+/* Function for merging the models of from into set, keeping the smallest
+ * program index of every model and adding up the duplicates found. */
+void merge_model_sets(ModelSet *set, const ModelSet *from) {
+    for (size_t j = 0; j < from->n_models; j++) {
+        Model m = model_set_at(from, j);
+        model_set_insert(set, &m, from->first_programs[j]);
+    }
+    set->n_duplicates += from->n_duplicates;
+}
+
+/* Comparator ordering (program, position) pairs by program index. */
+int compare_first_programs(const void *a, const void *b) {
+    uint64_t x = ((const uint64_t *)a)[0], y = ((const uint64_t *)b)[0];
+    return (x > y) - (x < y);
+}
+
+/* Function for sorting a set of models by the index of the first program
+ * producing them, i.e. in the order a sequential search would find them. */
+void sort_model_set(ModelSet *set) {
+    uint64_t (*order)[2] = safe_malloc((set->n_models > 0 ? set->n_models : 1) * sizeof(*order));
+    for (size_t j = 0; j < set->n_models; j++) {
+        order[j][0] = set->first_programs[j];
+        order[j][1] = (uint64_t)j;
+    }
+    qsort(order, set->n_models, sizeof(*order), compare_first_programs);
+    ModelWord *words = safe_malloc(set->capacity * set->n_words * sizeof(ModelWord));
+    for (size_t j = 0; j < set->n_models; j++) {
+        Model m = model_set_at(set, (size_t)order[j][1]);
+        memcpy(words + j * set->n_words, m.words, set->n_words * sizeof(ModelWord));
+        set->first_programs[j] = order[j][0];
+    }
+    free(set->words);
+    set->words = words;
+    free(order);
+    rehash_model_set(set, set->n_slots);
+}
+
+/* Comparator ordering models by their words, the first word first: the
+ * canonical order of the runs of spilled models. */
+int compare_models(const void *a, const void *b) {
+    const Model *x = a, *y = b;
+    for (int w = 0; w < x->n_words; w++) {
+        if (x->words[w] != y->words[w]) return x->words[w] < y->words[w] ? -1 : 1;
+    }
+    return 0;
+}
+
+/* Function for the bytes a model n_words wide may take in a set: its
+ * words and first program, twice over as the buffers double, up to four
+ * hash slots and its entry in the order sorted when spilling. */
+size_t model_memory(int n_words) {
+    return 2 * ((size_t)n_words * sizeof(ModelWord) + sizeof(uint64_t)) + 4 * sizeof(ptrdiff_t) + sizeof(Model);
+}
+
+/* Function for the number of models n_words wide that each of n_sets sets
+ * can hold when they share max_memory bytes. */
+size_t models_within_memory(size_t max_memory, int n_sets, int n_words) {
+    return max_memory / n_sets / model_memory(n_words);
+}
+
+/* Function for initializing an empty set of runs of models n_words wide. */
+void init_model_runs(ModelRuns *runs, int n_words) {
+    runs->n_words = n_words;
+    runs->n_runs = 0;
+    runs->n_duplicates = 0;
+}
+
+/* Free a set of runs, closing (thus deleting) their temporary files. */
+void free_model_runs(ModelRuns *runs) {
+    for (int r = 0; r < runs->n_runs; r++) fclose(runs->files[r]);
+    runs->n_runs = 0;
+}
+
+/* Visitor writing a model at the end of the run file context points to. */
+void write_run_model(const Model *model, void *context) {
+    if (fwrite(model->words, sizeof(ModelWord), model->n_words, context) != (size_t)model->n_words) {
+        perror("Writing spilled models failed!");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* Function for reading the next model of a run into words.
+ * Returns false at the end of the run. */
+bool read_run_model(FILE *file, ModelWord *words, int n_words) {
+    if (fread(words, sizeof(ModelWord), n_words, file) == (size_t)n_words) return true;
+    if (ferror(file)) {
+        perror("Reading spilled models failed!");
+        exit(EXIT_FAILURE);
+    }
+    return false;
+}
+
+/* Function for restoring the heap property of a min-heap of runs, ordered
+ * by their head models, below the given position. */
+void run_heap_sift_down(int *heap, int n_heap, int position, ModelWord *heads, int n_words) {
+    while (true) {
+        int smallest = position;
+        for (int child = 2 * position + 1; child <= 2 * position + 2 && child < n_heap; child++) {
+            Model x = { heads + (size_t)heap[child] * n_words, n_words };
+            Model y = { heads + (size_t)heap[smallest] * n_words, n_words };
+            if (compare_models(&x, &y) < 0) smallest = child;
+        }
+        if (smallest == position) return;
+        int run = heap[position];
+        heap[position] = heap[smallest];
+        heap[smallest] = run;
+        position = smallest;
+    }
+}
+
+/* Function for merging the runs of spilled models, k ways, handing each
+ * distinct model to visit, if any, in increasing order; the duplicates
+ * met across runs are added to runs->n_duplicates. Memory stays at one
+ * head model per run. Returns the number of distinct models. */
+uint64_t merge_model_runs(ModelRuns *runs, NewModelVisitor visit, void *context) {
+    int n_words = runs->n_words, n_heap = 0;
+    ModelWord *heads = safe_malloc(((size_t)runs->n_runs + 1) * n_words * sizeof(ModelWord));
+    Model last = { heads + (size_t)runs->n_runs * n_words, n_words };
+    int *heap = safe_malloc((runs->n_runs > 0 ? runs->n_runs : 1) * sizeof(int));
+    for (int r = 0; r < runs->n_runs; r++) {
+        rewind(runs->files[r]);
+        if (read_run_model(runs->files[r], heads + (size_t)r * n_words, n_words)) heap[n_heap++] = r;
+    }
+    for (int i = n_heap / 2 - 1; i >= 0; i--) run_heap_sift_down(heap, n_heap, i, heads, n_words);
+    uint64_t n_models = 0;
+    while (n_heap > 0) {
+        int r = heap[0];
+        Model head = { heads + (size_t)r * n_words, n_words };
+        if (n_models > 0 && model_equal(&head, &last)) {
+            runs->n_duplicates++;
+        } else {
+            memcpy(last.words, head.words, n_words * sizeof(ModelWord));
+            n_models++;
+            if (visit) visit(&head, context);
+        }
+        if (!read_run_model(runs->files[r], head.words, n_words)) heap[0] = heap[--n_heap];
+        run_heap_sift_down(heap, n_heap, 0, heads, n_words);
+    }
+    free(heads);
+    free(heap);
+    return n_models;
+}
+
+/* Function for creating an empty temporary file for a run. */
+FILE *new_run_file(void) {
+    FILE *file = tmpfile();
+    if (!file) {
+        perror("Temporary file creation failed!");
+        exit(EXIT_FAILURE);
+    }
+    return file;
+}
+
+/* Function for adding a run file to a set of runs, which takes it over.
+ * When MAX_OPEN_RUNS are already open, they are first merged into one. */
+void add_model_run(ModelRuns *runs, FILE *file) {
+    if (runs->n_runs == MAX_OPEN_RUNS) {
+        FILE *merged = new_run_file();
+        merge_model_runs(runs, write_run_model, merged);
+        free_model_runs(runs);
+        runs->files[runs->n_runs++] = merged;
+    }
+    runs->files[runs->n_runs++] = file;
+}
+
+/* Function for spilling a set of models to a new run, sorted by
+ * compare_models, and emptying it; its duplicates go to the runs. */
+void spill_model_set(ModelSet *set, ModelRuns *runs) {
+    Model *order = safe_malloc((set->n_models > 0 ? set->n_models : 1) * sizeof(Model));
+    for (size_t j = 0; j < set->n_models; j++) order[j] = model_set_at(set, j);
+    qsort(order, set->n_models, sizeof(Model), compare_models);
+    FILE *file = new_run_file();
+    for (size_t j = 0; j < set->n_models; j++) write_run_model(&order[j], file);
+    free(order);
+    STATS_ADD(models_spilled, set->n_models);
+    runs->n_duplicates += set->n_duplicates;
+    int n_words = set->n_words;
+    free_model_set(set);
+    init_model_set(set, n_words);
+    add_model_run(runs, file);
+}
+
+/* * * * * * * * * * * * * * * * * * * Computation * * * * * * * * * * * * * * * * * * * * */
+
+/* Encode a rule given body, head, and rule type.
+ * Allocate and copy both body and head into the rule structure.
+ */
+Rule encode_rule(int n_body, int n_head, Atom *body, Atom *head, RuleType ruletype) {
+    Rule r;
+    
+    /* Copy body */
+    r.n_atoms_in_body = n_body;
+    r.body = safe_malloc(n_body * sizeof(Atom));
+    for (int i = 0; i < n_body; i++) {
+        r.body[i] = body[i];
+    }
+    
+    /* Copy head or set ⊥ for constraint */
+    if (n_head == 0) {
+        r.n_atoms_in_head = 1;
+        r.head = safe_malloc(sizeof(Atom));
+        
+        /* Special atom meaning ⊥. */
+        r.head[0] = BOTTOM;
+    } else {
+        r.n_atoms_in_head = n_head;
+        r.head = safe_malloc(n_head * sizeof(Atom));
+        for (int i = 0; i < n_head; i++) {
+            r.head[i] = head[i];
+        }
+    }
+    r.ruletype = ruletype;
+    return r;
+}
+
+/* Free an array of Rule structures and their allocated fields. */
+void free_rules(Rule *rules, int count) {
+    for (int i = 0; i < count; i++) {
+        free(rules[i].body);
+        free(rules[i].head);
+    }
+    free(rules);
+}
+
+/* Function for building the clause pool of a set of rules in an arena:
+ * one clause h ← body(r) for every rule r and atom h of its head, in head
+ * order (a constraint contributes its single clause ⊥ ← body(r)). Clause
+ * bodies point to the bodies of the rules, which must outlive the pool. */
+ClausePool build_clause_pool(Rule *rules, int n_rules, Arena *arena) {
+    ClausePool pool;
+    pool.first_clause = arena_alloc(arena, (n_rules + 1) * sizeof(int));
+    pool.n_clauses = 0;
+    for (int i = 0; i < n_rules; i++) {
+        pool.first_clause[i] = pool.n_clauses;
+        pool.n_clauses += rules[i].n_atoms_in_head > 0 ? rules[i].n_atoms_in_head : 1;
+    }
+    pool.first_clause[n_rules] = pool.n_clauses;
+    pool.clauses = arena_alloc(arena, pool.n_clauses * sizeof(DefiniteClause));
+    for (int i = 0; i < n_rules; i++) {
+        for (int k = pool.first_clause[i]; k < pool.first_clause[i + 1]; k++) {
+            DefiniteClause *clause = &pool.clauses[k];
+            clause->head = rules[i].n_atoms_in_head > 0 ? rules[i].head[k - pool.first_clause[i]] : BOTTOM;
+            clause->body = rules[i].body;
+            clause->n_atoms_in_body = rules[i].n_atoms_in_body;
+        }
+    }
+    return pool;
+}
+
+/* Function for computing defᵣ for the rule with the given index.
+ * Its definite programs are spans of indices of the rule's clauses in the
+ * pool; both the programs and the spans are allocated in the arena. */
+DefiniteProgram *defr(Rule rule, const ClausePool *pool, int rule_index, Arena *arena, int *n_definite_programs) {
+    int n_atoms_in_head = rule.n_atoms_in_head;
+    int first_clause = pool->first_clause[rule_index];
+    
+    /* Void head. */
+    if (n_atoms_in_head == 0) {
+        DefiniteProgram *defr = arena_alloc(arena, sizeof(DefiniteProgram));
+        defr[0].clauses = pool->clauses;
+        defr[0].n_clauses = 1;
+        defr[0].clause_ids = arena_alloc(arena, sizeof(int));
+        defr[0].clause_ids[0] = first_clause;
+        *n_definite_programs = 1;
+        return defr;
+    }
+    
+    /* 2^n possible subsets of head (C); n is at most MAX_ENUMERABLE_HEAD_ATOMS. */
+    uint64_t total_subsets = (uint64_t)1 << n_atoms_in_head;
+    DefiniteProgram *defr = arena_alloc(arena, total_subsets * sizeof(DefiniteProgram));
+    int n_definite_programs_generated = 0;
+    
+    /* Cycle through all possible binary masks i.e., all subsets of head atoms. */
+    for (uint64_t bitmask = 0; bitmask < total_subsets; bitmask++) {
+        int clause_count = __builtin_popcountll(bitmask);
+        
+        /* If void subset and rule is imperative, skip (constraint cannot be empty for ⊢). */
+        if (clause_count == 0 && rule.ruletype == IMPERATIVE) continue;
+        
+        /* If void subset and rule is permissive, the program is empty. */
+        DefiniteProgram *program = &defr[n_definite_programs_generated++];
+        program->clauses = pool->clauses;
+        program->n_clauses = clause_count;
+        program->clause_ids = clause_count > 0 ? arena_alloc(arena, clause_count * sizeof(int)) : NULL;
+        
+        /* For each selected atom in bitmask, take its clause from the pool. */
+        int clause_index = 0;
+        for (int i = 0; i < n_atoms_in_head; i++) {
+            if (bitmask & ((uint64_t)1 << i)) program->clause_ids[clause_index++] = first_clause + i;
+        }
+    }
+    *n_definite_programs = n_definite_programs_generated;
+    return defr;
+}
+
+/* Function for checking whether a rule is a constraint (⊢ ⊥). */
+bool is_constraint(Rule r) {
+    return r.ruletype == IMPERATIVE && r.n_atoms_in_head == 1 && r.head[0] == BOTTOM;
+}
+
+/* Function for computing |def(R)| = Π |defᵣ(rᵢ)| in closed form, without
+ * enumerating anything: a head of n atoms has 2^n subsets, all of which are
+ * options of a permissive rule, while an imperative rule excludes the empty
+ * one and a constraint has a single option. Powers of two are added up into
+ * a single final shift, and the factors 2^n - 1 are batched into 32-bit
+ * words before being multiplied into the count. */
+BigCount count_def_programs(Rule *rules, int n_rules) {
+    BigCount count;
+    init_bigcount(&count, 1);
+    uint32_t factor = 1;
+    int shift = 0;
+    for (int i = 0; i < n_rules; i++) {
+        if (is_constraint(rules[i])) continue;
+        int n = rules[i].n_atoms_in_head;
+        if (rules[i].ruletype == PERMISSIVE) {
+            shift += n;
+            continue;
+        }
+        if (n < 32) {
+            uint32_t options = ((uint32_t)1 << n) - 1;
+            if (factor > UINT32_MAX / options) {
+                bigcount_multiply(&count, factor);
+                factor = 1;
+            }
+            factor *= options;
+            continue;
+        }
+        
+        /* Wide imperative heads: multiply by 2^n, then subtract the count. */
+        bigcount_multiply(&count, factor);
+        factor = 1;
+        BigCount before;
+        before.n_limbs = count.n_limbs;
+        before.limbs = safe_malloc((count.n_limbs > 0 ? count.n_limbs : 1) * sizeof(uint32_t));
+        memcpy(before.limbs, count.limbs, count.n_limbs * sizeof(uint32_t));
+        bigcount_shift_left(&count, n);
+        bigcount_subtract(&count, &before);
+        free_bigcount(&before);
+    }
+    bigcount_multiply(&count, factor);
+    bigcount_shift_left(&count, shift);
+    return count;
+}
+
+/* Function for finding a rule whose head is too wide for defᵣ(r) to be
+ * enumerated. Returns its index, or -1 if every rule can be enumerated. */
+int find_unenumerable_rule(Rule *rules, int n_rules) {
+    for (int i = 0; i < n_rules; i++) {
+        if (rules[i].n_atoms_in_head > MAX_ENUMERABLE_HEAD_ATOMS) return i;
+    }
+    return -1;
+}
+
+/* Function for compiling a set of rules over the atoms 0 .. n_atoms - 1,
+ * i.e. building their clause pool and watch lists and computing defᵣ(r)
+ * once for every rule r ∈ R. */
+CompiledRules compile_rules(Rule *rules, int n_rules, int n_atoms) {
+    CompiledRules compiled;
+    compiled.rules = rules;
+    compiled.n_rules = n_rules;
+    compiled.n_atoms = n_atoms;
+    compiled.n_words = model_words_for(n_atoms);
+    compiled.arena.blocks = NULL;
+    compiled.pool = build_clause_pool(rules, n_rules, &compiled.arena);
+    compiled.n_options = safe_malloc((n_rules > 0 ? n_rules : 1) * sizeof(int));
+    compiled.defrs = safe_malloc((n_rules > 0 ? n_rules : 1) * sizeof(DefiniteProgram *));
+    compiled.is_constraint = safe_malloc((n_rules > 0 ? n_rules : 1) * sizeof(bool));
+    compiled.max_clauses = compiled.pool.n_clauses;
+    for (int i = 0; i < n_rules; i++) {
+        compiled.is_constraint[i] = is_constraint(rules[i]);
+        compiled.defrs[i] = defr(rules[i], &compiled.pool, i, &compiled.arena, &compiled.n_options[i]);
+    }
+    
+    /* Count |def(R)| and the programs under each node of the choice tree. */
+    compiled.program_strides = safe_malloc((n_rules + 1) * sizeof(uint64_t));
+    compiled.program_strides[n_rules] = 1;
+    compiled.n_programs_overflows = false;
+    for (int i = n_rules - 1; i >= 0; i--) {
+        if (__builtin_mul_overflow(compiled.program_strides[i + 1], (uint64_t)compiled.n_options[i], &compiled.program_strides[i])) {
+            compiled.program_strides[i] = UINT64_MAX;
+            compiled.n_programs_overflows = true;
+        }
+    }
+    compiled.n_programs = compiled.program_strides[0];
+    
+    /* Index every rule by each of its body atoms. */
+    compiled.watch_start = safe_malloc((n_atoms + 1) * sizeof(int));
+    memset(compiled.watch_start, 0, (n_atoms + 1) * sizeof(int));
+    for (int i = 0; i < n_rules; i++) {
+        for (int k = 0; k < rules[i].n_atoms_in_body; k++) {
+            compiled.watch_start[rules[i].body[k] + 1]++;
+        }
+    }
+    for (int a = 0; a < n_atoms; a++) {
+        compiled.watch_start[a + 1] += compiled.watch_start[a];
+    }
+    int n_watches = compiled.watch_start[n_atoms];
+    compiled.watch_rules = safe_malloc((n_watches > 0 ? n_watches : 1) * sizeof(int));
+    int *watch_fill = safe_malloc((n_atoms + 1) * sizeof(int));
+    memcpy(watch_fill, compiled.watch_start, (n_atoms + 1) * sizeof(int));
+    for (int i = 0; i < n_rules; i++) {
+        for (int k = 0; k < rules[i].n_atoms_in_body; k++) {
+            compiled.watch_rules[watch_fill[rules[i].body[k]]++] = i;
+        }
+    }
+    free(watch_fill);
+    return compiled;
+}
+
+/* Free the clause pool and defᵣ options held by a CompiledRules
+ * (the rules are not owned); the arena releases all of them in one shot. */
+void free_compiled_rules(CompiledRules *compiled) {
+    free_arena(&compiled->arena);
+    free(compiled->defrs);
+    free(compiled->n_options);
+    free(compiled->watch_start);
+    free(compiled->watch_rules);
+    free(compiled->program_strides);
+    free(compiled->is_constraint);
+}
+
+/* Function for assembling the program of def(R) selected by a choice
+ * vector: the clause indices of the chosen program of each defᵣ(rᵢ) are
+ * copied into program, whose span must have room for compiled->max_clauses
+ * indices. */
+void assemble_program(const CompiledRules *compiled, const int *choice, DefiniteProgram *program) {
+    program->clauses = compiled->pool.clauses;
+    program->n_clauses = 0;
+    for (int i = 0; i < compiled->n_rules; i++) {
+        DefiniteProgram selected = compiled->defrs[i][choice[i]];
+        for (int j = 0; j < selected.n_clauses; j++) {
+            program->clause_ids[program->n_clauses++] = selected.clause_ids[j];
+        }
+    }
+}
+
+/* Function for enumerating def(R), the set of definite programs obtained
+ * from a set of rules, one program at a time.
+ * Programs are never materialized all together: each combination of choices
+ * (one definite program from each defᵣ(rᵢ)) is assembled as a span of clause
+ * indices in a scratch buffer, handed to visit together
+ * with its choice vector, and overwritten by the next one. Peak memory is
+ * therefore proportional to |R| and not to |def(R)|.
+ * Enumeration stops early if visit returns false.
+ * Returns the number of programs visited.
+ */
+uint64_t defR(const CompiledRules *compiled, DefiniteProgramVisitor visit, void *context) {
+    int n_rules = compiled->n_rules;
+    
+    /* Scratch program reused for every combination of choices. */
+    DefiniteProgram program;
+    program.clause_ids = safe_malloc((compiled->max_clauses > 0 ? compiled->max_clauses : 1) * sizeof(int));
+    int *choice = safe_malloc((n_rules > 0 ? n_rules : 1) * sizeof(int));
+    for (int i = 0; i < n_rules; i++) choice[i] = 0;
+    
+    /* Cycle through all combinations of choices, the last rule varying fastest. */
+    uint64_t n_visited = 0;
+    bool more = true;
+    while (more) {
+        
+        /* Combine chosen clauses from each rule to form one definite program. */
+        assemble_program(compiled, choice, &program);
+        n_visited++;
+        STATS_ADD(programs_enumerated, 1);
+        if (!visit(program, choice, context)) break;
+        
+        /* Advance the choice vector like a mixed-radix counter. */
+        more = false;
+        for (int i = n_rules - 1; i >= 0; i--) {
+            if (++choice[i] < compiled->n_options[i]) {
+                more = true;
+                break;
+            }
+            choice[i] = 0;
+        }
+    }
+    free(choice);
+    free(program.clause_ids);
+    return n_visited;
+}
+
+/* Function for adding the head atoms of a rule to a closure, and queueing
+ * those that are new. */
+void add_rule_heads(const Rule *r, Model *closure, Atom *queue, int *n_queue) {
+    for (int k = 0; k < r->n_atoms_in_head; k++) {
+        Atom h = r->head[k];
+        if (h != BOTTOM && !model_contains(closure, h)) {
+            model_add(closure, h);
+            queue[(*n_queue)++] = h;
+        }
+    }
+}
+
+/* Function for closing a set of facts under the rules selected by
+ * selected[i]: a selected rule whose body is in the closure adds all of
+ * its head atoms. Returns the closure, to be freed with free_model. */
+Model close_facts(const CompiledRules *compiled, Atom *facts, int n_facts, const bool *selected) {
+    Model closure = new_model(compiled->n_words);
+    int *missing = safe_malloc((compiled->n_rules > 0 ? compiled->n_rules : 1) * sizeof(int));
+    Atom *queue = safe_malloc((compiled->n_atoms > 0 ? compiled->n_atoms : 1) * sizeof(Atom));
+    int n_queue = 0;
+    for (int f = 0; f < n_facts; f++) {
+        if (model_contains(&closure, facts[f])) continue;
+        model_add(&closure, facts[f]);
+        queue[n_queue++] = facts[f];
+    }
+    for (int i = 0; i < compiled->n_rules; i++) {
+        missing[i] = compiled->rules[i].n_atoms_in_body;
+        if (missing[i] == 0 && selected[i]) add_rule_heads(&compiled->rules[i], &closure, queue, &n_queue);
+    }
+    for (int q = 0; q < n_queue; q++) {
+        Atom a = queue[q];
+        for (int w = compiled->watch_start[a]; w < compiled->watch_start[a + 1]; w++) {
+            int rule = compiled->watch_rules[w];
+            if (--missing[rule] == 0 && selected[rule]) add_rule_heads(&compiled->rules[rule], &closure, queue, &n_queue);
+        }
+    }
+    free(queue);
+    free(missing);
+    return closure;
+}
+
+/* Function for shrinking def(R) before it is searched from a set of facts
+ * A, by keeping a single option of defᵣ(r) per class of options that give
+ * the same least models in every program:
+ *   - a rule is dead when some atom of its body is not derivable, i.e. not
+ *     in the closure of A under all the heads of all the rules: it never
+ *     fires, so all its options are equivalent;
+ *   - a head atom is redundant when it is certain, i.e. in the closure of A
+ *     under the rules with a single option, which belong to every program;
+ *     when it is in the body of its own rule; or when it is ⊥ in a rule that
+ *     is not a constraint, since such clauses never fire. Options with the
+ *     same non-redundant head atoms are equivalent.
+ * The first option of every class is kept, so options keep their relative
+ * order and the first program producing a model comes first as before.
+ * The compiled rules are changed in place and can no longer enumerate the
+ * full def(R).
+ */
+ProgramSpaceReduction reduce_program_space(CompiledRules *compiled, Atom *facts, int n_facts) {
+    int n_rules = compiled->n_rules;
+    ProgramSpaceReduction reduction;
+    reduction.n_programs_before = compiled->n_programs;
+    reduction.n_programs_before_overflows = compiled->n_programs_overflows;
+    reduction.n_options_before = 0;
+    reduction.n_options_after = 0;
+    reduction.n_dead_rules = 0;
+    bool *selected = safe_malloc((n_rules > 0 ? n_rules : 1) * sizeof(bool));
+    memset(selected, 0, (n_rules > 0 ? n_rules : 1) * sizeof(bool));
+    for (int i = 0; i < n_rules; i++) {
+        selected[i] = !compiled->is_constraint[i];
+    }
+    Model derivable = close_facts(compiled, facts, n_facts, selected);
+    for (int i = 0; i < n_rules; i++) {
+        selected[i] = !compiled->is_constraint[i] && compiled->n_options[i] == 1;
+    }
+    Model certain = close_facts(compiled, facts, n_facts, selected);
+    free(selected);
+    
+    for (int i = 0; i < n_rules; i++) {
+        const Rule *r = &compiled->rules[i];
+        reduction.n_options_before += compiled->n_options[i];
+        bool dead = false;
+        for (int k = 0; k < r->n_atoms_in_body && !dead; k++) {
+            dead = !model_contains(&derivable, r->body[k]);
+        }
+        if (dead) {
+            reduction.n_dead_rules++;
+            compiled->n_options[i] = 1;
+            reduction.n_options_after++;
+            continue;
+        }
+        
+        /* Map every head position to the first position of the same atom,
+         * or to none when the atom is redundant. */
+        int n_head = r->n_atoms_in_head;
+        uint64_t relevant = 0;
+        int *canonical = safe_malloc((n_head > 0 ? n_head : 1) * sizeof(int));
+        for (int k = 0; k < n_head; k++) {
+            Atom h = r->head[k];
+            bool redundant = h == BOTTOM ? !compiled->is_constraint[i] : model_contains(&certain, h);
+            for (int j = 0; j < r->n_atoms_in_body && !redundant; j++) {
+                redundant = r->body[j] == h;
+            }
+            canonical[k] = k;
+            for (int j = 0; j < k; j++) {
+                if (r->head[j] == h) {
+                    canonical[k] = j;
+                    break;
+                }
+            }
+            if (!redundant) relevant |= (uint64_t)1 << canonical[k];
+        }
+        
+        /* Keep the first option of every class of options with the same relevant heads. */
+        int first_clause = compiled->pool.first_clause[i];
+        size_t seen_bytes = n_head < 3 ? 1 : ((size_t)1 << n_head) / 8;
+        uint8_t *seen = safe_malloc(seen_bytes);
+        memset(seen, 0, seen_bytes);
+        int n_kept = 0;
+        for (int o = 0; o < compiled->n_options[i]; o++) {
+            DefiniteProgram option = compiled->defrs[i][o];
+            uint64_t key = 0;
+            for (int c = 0; c < option.n_clauses; c++) {
+                key |= (uint64_t)1 << canonical[option.clause_ids[c] - first_clause];
+            }
+            key &= relevant;
+            if (seen[key / 8] & (1 << (key % 8))) continue;
+            seen[key / 8] |= 1 << (key % 8);
+            compiled->defrs[i][n_kept++] = option;
+        }
+        compiled->n_options[i] = n_kept;
+        reduction.n_options_after += n_kept;
+        free(seen);
+        free(canonical);
+    }
+    free_model(&derivable);
+    free_model(&certain);
+    
+    /* Count the programs left under each node of the choice tree. */
+    compiled->n_programs_overflows = false;
+    for (int i = n_rules - 1; i >= 0; i--) {
+        if (__builtin_mul_overflow(compiled->program_strides[i + 1], (uint64_t)compiled->n_options[i], &compiled->program_strides[i])) {
+            compiled->program_strides[i] = UINT64_MAX;
+            compiled->n_programs_overflows = true;
+        }
+    }
+    compiled->n_programs = compiled->program_strides[0];
+    reduction.n_programs_after = compiled->n_programs;
+    reduction.n_programs_after_overflows = compiled->n_programs_overflows;
+    return reduction;
+}
+
+/* Compute the least model of a definite program D given
+ * an initial set of facts A, in time linear in the size of D
+ * (Dowling–Gallier). Every clause keeps a counter of the atoms of its
+ * body that are not yet in the model, and is indexed by each of its body
+ * atoms (a repeated body atom counts, and is indexed, once per
+ * occurrence). Starting from M0(D, A) = A, every atom entering the model
+ * is queued; when it is dequeued, the counters of the clauses whose body
+ * contains it are decremented, and a clause whose counter drops to zero
+ * adds its head to the model. The model is allocated over the atoms
+ * 0 .. n_atoms - 1 and must be freed with free_model.
+ */
+Model least_model(DefiniteProgram D, Atom *facts, int n_facts, int n_atoms) {
+    
+    /* M0(D, A) = A */
+    Model M = new_model(model_words_for(n_atoms));
+    model_set_atoms(&M, facts, n_facts);
+    
+    /* Count body atoms per clause and clauses per body atom. */
+    int *missing = safe_malloc((D.n_clauses > 0 ? D.n_clauses : 1) * sizeof(int));
+    int *watch_start = safe_malloc((n_atoms + 1) * sizeof(int));
+    memset(watch_start, 0, (n_atoms + 1) * sizeof(int));
+    for (int i = 0; i < D.n_clauses; i++) {
+        const DefiniteClause *clause = &D.clauses[D.clause_ids[i]];
+        missing[i] = clause->n_atoms_in_body;
+        for (int k = 0; k < clause->n_atoms_in_body; k++) {
+            watch_start[clause->body[k] + 1]++;
+        }
+    }
+    for (int a = 0; a < n_atoms; a++) {
+        watch_start[a + 1] += watch_start[a];
+    }
+    
+    /* Index every clause by each of its body atoms. */
+    int *watch_clauses = safe_malloc((watch_start[n_atoms] > 0 ? watch_start[n_atoms] : 1) * sizeof(int));
+    int *watch_fill = safe_malloc((n_atoms + 1) * sizeof(int));
+    memcpy(watch_fill, watch_start, (n_atoms + 1) * sizeof(int));
+    for (int i = 0; i < D.n_clauses; i++) {
+        const DefiniteClause *clause = &D.clauses[D.clause_ids[i]];
+        for (int k = 0; k < clause->n_atoms_in_body; k++) {
+            watch_clauses[watch_fill[clause->body[k]]++] = i;
+        }
+    }
+    
+    /* The queue holds every atom of M in order of entry. */
+    Atom *queue = safe_malloc(M.n_words * MODEL_WORD_BITS * sizeof(Atom));
+    int n_queue = model_atoms(&M, queue);
+    for (int i = 0; i < D.n_clauses; i++) {
+        Atom h = D.clauses[D.clause_ids[i]].head;
+        
+        /* Clauses with an empty body fire right away (constraints never do). */
+        if (missing[i] == 0 && h != BOTTOM && !model_contains(&M, h)) {
+            model_add(&M, h);
+            queue[n_queue++] = h;
+        }
+    }
+    for (int q = 0; q < n_queue; q++) {
+        Atom a = queue[q];
+        STATS_ADD(fixpoint_iterations, 1);
+        STATS_ADD(clause_evaluations, watch_start[a + 1] - watch_start[a]);
+        for (int w = watch_start[a]; w < watch_start[a + 1]; w++) {
+            int i = watch_clauses[w];
+            Atom h = D.clauses[D.clause_ids[i]].head;
+            if (--missing[i] == 0 && h != BOTTOM && !model_contains(&M, h)) {
+                model_add(&M, h);
+                queue[n_queue++] = h;
+            }
+        }
+    }
+    free(watch_fill);
+    free(watch_clauses);
+    free(watch_start);
+    free(missing);
+    free(queue);
+    return M;
+}
+
+/* Function for restarting a depth-first search over def(R) from a set of
+ * facts A: the model becomes A, no rule has been chosen yet, and every rule
+ * counts the atoms of its body missing from A. Counters start from the body
+ * sizes and are decremented through the watch lists of the facts, so the
+ * cost depends on the rules watching A rather than on all the bodies. */
+void reset_def_search(DefSearch *search, Atom *facts, int n_facts) {
+    const CompiledRules *compiled = search->compiled;
+    model_clear(&search->model);
+    search->depth = 0;
+    search->n_trail = 0;
+    search->n_violated = 0;
+    search->coverage = 1;
+    for (int i = 0; i < compiled->n_rules; i++) {
+        search->missing[i] = compiled->rules[i].n_atoms_in_body;
+        if (search->missing[i] == 0 && compiled->is_constraint[i]) search->n_violated++;
+    }
+    for (int f = 0; f < n_facts; f++) {
+        Atom a = facts[f];
+        if (model_contains(&search->model, a)) continue;
+        model_add(&search->model, a);
+        STATS_ADD(clause_evaluations, compiled->watch_start[a + 1] - compiled->watch_start[a]);
+        for (int w = compiled->watch_start[a]; w < compiled->watch_start[a + 1]; w++) {
+            int rule = compiled->watch_rules[w];
+            if (--search->missing[rule] == 0 && compiled->is_constraint[rule]) search->n_violated++;
+        }
+    }
+}
+
+/* Function for initializing a depth-first search over def(R) from a set of
+ * facts A. With prune_violations, programs whose least model violates a
+ * constraint are not visited. */
+void init_def_search(DefSearch *search, const CompiledRules *compiled, Atom *facts, int n_facts, bool prune_violations) {
+    int n_rules = compiled->n_rules;
+    search->compiled = compiled;
+    search->model = new_model(compiled->n_words);
+    search->prune_violations = prune_violations;
+    search->choice = safe_malloc((n_rules > 0 ? n_rules : 1) * sizeof(int));
+    search->prefixes = safe_malloc((n_rules + 1) * sizeof(uint64_t));
+    search->missing = safe_malloc((n_rules > 0 ? n_rules : 1) * sizeof(int));
+    search->trail = safe_malloc((compiled->n_atoms > 0 ? compiled->n_atoms : 1) * sizeof(Atom));
+    search->trail_marks = safe_malloc((n_rules > 0 ? n_rules : 1) * sizeof(int));
+    search->deadline = 0;
+    search->n_nodes = 0;
+    reset_def_search(search, facts, n_facts);
+}
+
+/* Free the buffers of a depth-first search over def(R). */
+void free_def_search(DefSearch *search) {
+    free_model(&search->model);
+    free(search->choice);
+    free(search->prefixes);
+    free(search->missing);
+    free(search->trail);
+    free(search->trail_marks);
+}
+
+/* Function for firing the clauses chosen for a rule whose body is included
+ * in the model: their heads not yet in the model are added and queued. */
+void fire_rule_choice(DefSearch *search, int rule) {
+    DefiniteProgram selected = search->compiled->defrs[rule][search->choice[rule]];
+    STATS_ADD(clause_evaluations, selected.n_clauses);
+    for (int j = 0; j < selected.n_clauses; j++) {
+        Atom h = selected.clauses[selected.clause_ids[j]].head;
+        
+        /* Skip constraints (head = ⊥). */
+        if (h != BOTTOM && !model_contains(&search->model, h)) {
+            model_add(&search->model, h);
+            search->trail[search->n_trail++] = h;
+        }
+    }
+}
+
+/* Function for choosing option o of defᵣ(r) for the rule at the given depth.
+ * The model is extended to the least model of A and all chosen clauses,
+ * starting from the current model instead of from A: the work done for the
+ * shared prefix of choices is not repeated. Every atom added is pushed on
+ * the trail, and once dequeued it decrements the counters of the rules
+ * whose body contains it; a chosen rule whose counter drops to zero fires.
+ */
+void push_rule_choice(DefSearch *search, int depth, int o) {
+    const CompiledRules *compiled = search->compiled;
+    search->choice[depth] = o;
+    search->trail_marks[depth] = search->n_trail;
+    search->depth = depth + 1;
+    if (search->missing[depth] == 0) fire_rule_choice(search, depth);
+    for (int q = search->trail_marks[depth]; q < search->n_trail; q++) {
+        Atom a = search->trail[q];
+        STATS_ADD(fixpoint_iterations, 1);
+        STATS_ADD(clause_evaluations, compiled->watch_start[a + 1] - compiled->watch_start[a]);
+        for (int w = compiled->watch_start[a]; w < compiled->watch_start[a + 1]; w++) {
+            int rule = compiled->watch_rules[w];
+            if (--search->missing[rule] > 0) continue;
+            if (compiled->is_constraint[rule]) {
+                search->n_violated++;
+            } else if (rule < search->depth) {
+                fire_rule_choice(search, rule);
+            }
+        }
+    }
+}
+
+/* Function for undoing the choice made at the given depth: the atoms it
+ * derived are popped from the trail and the counters they had decremented
+ * are restored. */
+void pop_rule_choice(DefSearch *search, int depth) {
+    const CompiledRules *compiled = search->compiled;
+    while (search->n_trail > search->trail_marks[depth]) {
+        Atom a = search->trail[--search->n_trail];
+        model_remove(&search->model, a);
+        for (int w = compiled->watch_start[a]; w < compiled->watch_start[a + 1]; w++) {
+            int rule = compiled->watch_rules[w];
+            if (search->missing[rule]++ == 0 && compiled->is_constraint[rule]) search->n_violated--;
+        }
+    }
+    search->depth = depth;
+}
+
+/* Function for claiming the program with the given index for a worker.
+ * Returns false if the index lies past the end of the worker's range. */
+bool claim_program(SearchWorker *worker, uint64_t program) {
+    pthread_mutex_lock(&worker->lock);
+    bool claimed = program < worker->end;
+    if (claimed) __atomic_store_n(&worker->next, program + 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&worker->lock);
+    return claimed;
+}
+
+/* Function for the fraction of def(R) a search has covered when it is at
+ * a node of the given depth whose first o children (or the node itself,
+ * o being 1, for a leaf) were searched: the programs before the node, in
+ * search order, and those of these children. */
+double search_coverage(const DefSearch *search, int depth, int o) {
+    const CompiledRules *compiled = search->compiled;
+    double covered = 0, scale = 1;
+    for (int d = 0; d < depth; d++) {
+        scale /= compiled->n_options[d];
+        covered += search->choice[d] * scale;
+    }
+    return covered + (depth < compiled->n_rules ? o * scale / compiled->n_options[depth] : o * scale);
+}
+
+/* Function for running a depth-first search from its root: try every
+ * option of defᵣ(r) for the rule at each depth, and hand the least model
+ * to visit at the leaves. The search is iterative, so that its depth (one
+ * level per rule) is not bounded by the call stack. prefixes[depth] is the
+ * mixed-radix number formed by the choices made so far, so that at the
+ * leaves it is the index of the program in def(R).
+ * When a worker is given, only the programs of its range are visited.
+ * Least models only grow along a branch, so once a constraint is violated
+ * it stays violated in every program below: with prune_violations the
+ * whole subtree is skipped.
+ * Returns false if visit asked to stop, the deadline passed or the
+ * worker's range is over, in which case the search is left where it
+ * stopped until reset_def_search.
+ */
+bool run_def_search(DefSearch *search, SearchWorker *worker, ModelVisitor visit, void *context) {
+    const CompiledRules *compiled = search->compiled;
+    int depth = 0, o = 0;
+    search->prefixes[0] = 0;
+    while (true) {
+        
+        /* Read the clock every 1024 nodes against the deadline, if any. */
+        if (search->deadline > 0 && (++search->n_nodes & 1023) == 0 && now_seconds() >= search->deadline) {
+            search->coverage = search_coverage(search, depth, o);
+            return false;
+        }
+        bool pruned = search->prune_violations && search->n_violated > 0;
+        if (pruned) STATS_ADD(subtrees_pruned, 1);
+        if (!pruned && depth == compiled->n_rules) {
+            uint64_t program = search->prefixes[depth];
+            if (worker && !claim_program(worker, program)) return false;
+            STATS_ADD(programs_enumerated, 1);
+            if (!visit(search, program, context)) {
+                search->coverage = search_coverage(search, depth, 1);
+                return false;
+            }
+        } else if (!pruned) {
+            
+            /* Descend into the next option o of the rule at this depth, if any. */
+            bool descended = false;
+            for (; o < compiled->n_options[depth]; o++) {
+                uint64_t child = search->prefixes[depth] * compiled->n_options[depth] + o;
+                if (worker) {
+                    
+                    /* Skip subtrees whose programs all lie before or after the range. */
+                    uint64_t first = child * compiled->program_strides[depth + 1];
+                    if (first + compiled->program_strides[depth + 1] <= worker->start) continue;
+                    if (first >= __atomic_load_n(&worker->end, __ATOMIC_RELAXED)) return false;
+                }
+                push_rule_choice(search, depth, o);
+                search->prefixes[++depth] = child;
+                o = 0;
+                descended = true;
+                break;
+            }
+            if (descended) continue;
+        }
+        
+        /* Backtrack to the parent node and move on to its next option. */
+        if (depth == 0) return true;
+        depth--;
+        o = search->choice[depth] + 1;
+        pop_rule_choice(search, depth);
+    }
+}
+
+/* Function for computing M(D, A) for every D ∈ def(R) by depth-first search
+ * over the choices of defᵣ(rᵢ), i.e. over a tree whose leaves are the
+ * programs of def(R), in the same order as defR. Programs sharing a prefix
+ * of choices share the fixpoint work done for that prefix, which is done
+ * once per tree node instead of once per leaf. With prune_violations, only
+ * the programs whose least model satisfies the constraints are visited.
+ * The search stops at the deadline, if any (0 for none). Returns the
+ * fraction of def(R) covered.
+ */
+double def_search(const CompiledRules *compiled, Atom *facts, int n_facts, bool prune_violations, double deadline,
+                  ModelVisitor visit, void *context) {
+    DefSearch search;
+    init_def_search(&search, compiled, facts, n_facts, prune_violations);
+    search.deadline = deadline;
+    run_def_search(&search, NULL, visit, context);
+    double coverage = search.coverage;
+    free_def_search(&search);
+    return coverage;
+}
+
+/* Function for stealing work for an idle worker: the worker with the most
+ * programs left gives away the upper half of them. Returns false if no
+ * worker has more than one program left. */
+bool steal_programs(SearchWorker *thief) {
+    ParallelSearch *parallel = thief->parallel;
+    while (true) {
+        SearchWorker *victim = NULL;
+        uint64_t most_left = 1;
+        for (int i = 0; i < parallel->n_workers; i++) {
+            SearchWorker *worker = &parallel->workers[i];
+            uint64_t next = __atomic_load_n(&worker->next, __ATOMIC_RELAXED);
+            uint64_t end = __atomic_load_n(&worker->end, __ATOMIC_RELAXED);
+            if (worker != thief && end > next && end - next > most_left) {
+                victim = worker;
+                most_left = end - next;
+            }
+        }
+        if (!victim) return false;
+        
+        /* Split the victim's remaining range under its lock, then take the
+         * upper half (the thief's own range is empty, so nobody steals from it). */
+        pthread_mutex_lock(&victim->lock);
+        uint64_t start = 0, end = 0;
+        if (victim->end > victim->next + 1) {
+            start = victim->next + (victim->end - victim->next) / 2;
+            end = victim->end;
+            __atomic_store_n(&victim->end, start, __ATOMIC_RELAXED);
+        }
+        pthread_mutex_unlock(&victim->lock);
+        if (end > start) {
+            pthread_mutex_lock(&thief->lock);
+            thief->start = start;
+            __atomic_store_n(&thief->next, start, __ATOMIC_RELAXED);
+            __atomic_store_n(&thief->end, end, __ATOMIC_RELAXED);
+            pthread_mutex_unlock(&thief->lock);
+            return true;
+        }
+    }
+}
+
+/* Thread body of a worker: search its own range, then keep stealing. */
+void *run_search_worker(void *arg) {
+    SearchWorker *worker = arg;
+    ParallelSearch *parallel = worker->parallel;
+    DefSearch search;
+    init_def_search(&search, parallel->compiled, parallel->facts, parallel->n_facts, parallel->prune_violations);
+    do {
+        reset_def_search(&search, parallel->facts, parallel->n_facts);
+        run_def_search(&search, worker, parallel->visit, worker->context);
+    } while (steal_programs(worker));
+    free_def_search(&search);
+    STATS_FLUSH();
+    return NULL;
+}
+
+/* Function for running def_search on n_threads threads. The index space
+ * of def(R) is split into n_threads contiguous ranges, one per worker, and
+ * workers that run out of programs steal from the others. Worker i hands
+ * its models to visit with contexts[i], so visitors need no locking; the
+ * program index passed to visit allows restoring the sequential order.
+ * The number of programs must fit in 64 bits.
+ */
+void parallel_def_search(const CompiledRules *compiled, Atom *facts, int n_facts, bool prune_violations, int n_threads, ModelVisitor visit, void **contexts) {
+    ParallelSearch parallel;
+    parallel.compiled = compiled;
+    parallel.facts = facts;
+    parallel.n_facts = n_facts;
+    parallel.prune_violations = prune_violations;
+    parallel.visit = visit;
+    parallel.n_workers = n_threads;
+    parallel.workers = safe_malloc(n_threads * sizeof(SearchWorker));
+    for (int i = 0; i < n_threads; i++) {
+        SearchWorker *worker = &parallel.workers[i];
+        pthread_mutex_init(&worker->lock, NULL);
+        worker->start = compiled->n_programs / n_threads * i;
+        worker->next = worker->start;
+        worker->end = (i == n_threads - 1) ? compiled->n_programs : compiled->n_programs / n_threads * (i + 1);
+        worker->context = contexts[i];
+        worker->parallel = &parallel;
+    }
+    for (int i = 0; i < n_threads; i++) {
+        if (pthread_create(&parallel.workers[i].thread, NULL, run_search_worker, &parallel.workers[i]) != 0) {
+            perror("Thread creation failed!");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (int i = 0; i < n_threads; i++) {
+        pthread_join(parallel.workers[i].thread, NULL);
+        pthread_mutex_destroy(&parallel.workers[i].lock);
+    }
+    free(parallel.workers);
+}
+
+/* Function for checking if a model satisfies all constraints in R. */
+bool satisfies_constraints(const CompiledRules *compiled, const Model *model) {
+    for (int i = 0; i < compiled->n_rules; i++) {
+        
+        /* Constraint (⊢ ⊥): the rule's body must *not* be fully satisfied by the model. */
+        if (!compiled->is_constraint[i]) continue;
+        const Rule *r = &compiled->rules[i];
+        int k = 0;
+        while (k < r->n_atoms_in_body && model_contains(model, r->body[k])) k++;
+        if (k == r->n_atoms_in_body) return false;
+    }
+
+    /* All constraints satisfied. */
+    return true;
+}
+
+/* Visitor for one leaf of the single pass over def(R): the program D is
+ * handed to the def(R) visitor, if any, and its least model M(D, A) is
+ * added to cnsᵈ(R,A) and, when it violates no constraint, to out₁(R,A).
+ * Duplicates are detected by the hash sets in amortized O(|M|) time. */
+bool collect_results(const DefSearch *search, uint64_t program, void *context) {
+    ResultsCollector *collector = context;
+    if (collector->def_visit) {
+        assemble_program(search->compiled, search->choice, &collector->program);
+        if (!collector->def_visit(collector->program, search->choice, collector->def_context)) return false;
+    }
+    if ((collector->stages & STAGE_CNSD) && model_set_insert(&collector->cnsd, &search->model, program)) {
+        if (collector->stream_stage == STAGE_CNSD) collector->stream_visit(&search->model, collector->stream_context);
+        if (collector->cnsd.n_models == collector->max_models_in_memory) spill_model_set(&collector->cnsd, &collector->cnsd_runs);
+    }
+    if ((collector->stages & STAGE_OUT1) && search->n_violated == 0) {
+        if (model_set_insert(&collector->out1, &search->model, program)) {
+            if (collector->stream_stage == STAGE_OUT1) collector->stream_visit(&search->model, collector->stream_context);
+            if (collector->out1.n_models == collector->max_models_in_memory) spill_model_set(&collector->out1, &collector->out1_runs);
+        }
+    } else if (collector->stages & STAGE_OUT1) {
+        STATS_ADD(models_rejected, 1);
+    }
+    return collector->max_models == 0 ||
+           (collector->cnsd.n_models < (size_t)collector->max_models && collector->out1.n_models < (size_t)collector->max_models);
+}
+
+/* Function for computing the requested stages of a run (def(R), cnsᵈ(R,A),
+ * out₁(R,A)) in a single pass over def(R): every program is visited once,
+ * its least model is computed once, incrementally along the search, and
+ * feeds both model sets, the constraint check coming for free from the
+ * counters of the search. The programs of def(R) are not stored; they are
+ * handed to def_visit, if given, in order, which makes the pass sequential.
+ * When out₁(R,A) is the only stage, subtrees violating a constraint are
+ * pruned. With more than one thread, every worker fills its own sets, and
+ * the sets are merged and sorted back into sequential order at the end.
+ * On a single thread, the models of stream_stage, if any, are also handed
+ * to stream_visit as soon as they are found, which results.streamed tells.
+ * A budget of models or time, if any, makes the search sequential and cuts
+ * it short. A memory budget is shared by the sets of all collectors; once
+ * one of them outgrows its share, the models of its stage all end up in
+ * sorted runs on disk (see merge_model_runs), and none are streamed.
+ */
+Results compute_results(const CompiledRules *compiled, Atom *facts, int n_facts, int stages, int n_threads,
+                        DefiniteProgramVisitor def_visit, void *def_context,
+                        Stage stream_stage, NewModelVisitor stream_visit, void *stream_context,
+                        const SearchBudget *budget) {
+    Results results;
+    results.streamed = 0;
+    results.coverage = 1;
+    results.n_def_programs = compiled->n_programs;
+    results.n_def_programs_overflows = compiled->n_programs_overflows;
+    init_model_set(&results.cnsd, compiled->n_words);
+    init_model_set(&results.out1, compiled->n_words);
+    init_model_runs(&results.cnsd_runs, compiled->n_words);
+    init_model_runs(&results.out1_runs, compiled->n_words);
+    if (!(stages & (STAGE_CNSD | STAGE_OUT1))) {
+        
+        /* No model is needed: enumerate def(R) without computing fixpoints. */
+        if (def_visit) defR(compiled, def_visit, def_context);
+        return results;
+    }
+    bool prune_violations = !(stages & (STAGE_DEF | STAGE_CNSD));
+    bool anytime = budget && (budget->max_models > 0 || budget->time_budget_ms > 0);
+    size_t max_memory = budget ? budget->max_memory : 0;
+    if (def_visit || anytime || compiled->n_programs_overflows || compiled->n_programs < (uint64_t)n_threads) n_threads = 1;
+    if (n_threads == 1 && (stages & stream_stage) && max_memory == 0) results.streamed = stream_stage;
+    int n_sets = n_threads * ((stages & STAGE_CNSD) && (stages & STAGE_OUT1) ? 2 : 1);
+    ResultsCollector *collectors = safe_malloc(n_threads * sizeof(ResultsCollector));
+    void **contexts = safe_malloc(n_threads * sizeof(void *));
+    for (int i = 0; i < n_threads; i++) {
+        collectors[i].stages = stages;
+        collectors[i].max_models = budget ? budget->max_models : 0;
+        collectors[i].max_models_in_memory = max_memory > 0 ? models_within_memory(max_memory, n_sets, compiled->n_words) : 0;
+        if (max_memory > 0 && collectors[i].max_models_in_memory < 1) collectors[i].max_models_in_memory = 1;
+        collectors[i].def_visit = def_visit;
+        collectors[i].def_context = def_context;
+        collectors[i].stream_stage = results.streamed;
+        collectors[i].stream_visit = stream_visit;
+        collectors[i].stream_context = stream_context;
+        collectors[i].program.clause_ids = def_visit ? safe_malloc((compiled->max_clauses > 0 ? compiled->max_clauses : 1) * sizeof(int)) : NULL;
+        collectors[i].cnsd = results.cnsd;
+        collectors[i].out1 = results.out1;
+        if (i > 0) {
+            init_model_set(&collectors[i].cnsd, compiled->n_words);
+            init_model_set(&collectors[i].out1, compiled->n_words);
+        }
+        init_model_runs(&collectors[i].cnsd_runs, compiled->n_words);
+        init_model_runs(&collectors[i].out1_runs, compiled->n_words);
+        contexts[i] = &collectors[i];
+    }
+    if (n_threads == 1) {
+        double deadline = anytime && budget->time_budget_ms > 0 ? now_seconds() + budget->time_budget_ms / 1000.0 : 0;
+        results.coverage = def_search(compiled, facts, n_facts, prune_violations, deadline, collect_results, contexts[0]);
+    } else {
+        parallel_def_search(compiled, facts, n_facts, prune_violations, n_threads, collect_results, contexts);
+    }
+    
+    /* Once a stage was spilled by some collector, or its sets would not fit in one once merged,
+     * spill the rest of its models too, into the runs of the first collector. */
+    for (Stage stage = STAGE_CNSD; stage <= STAGE_OUT1 && max_memory > 0; stage <<= 1) {
+        bool spilled = false;
+        size_t n_models = 0;
+        for (int i = 0; i < n_threads; i++) {
+            spilled |= (stage == STAGE_CNSD ? collectors[i].cnsd_runs : collectors[i].out1_runs).n_runs > 0;
+            n_models += (stage == STAGE_CNSD ? collectors[i].cnsd : collectors[i].out1).n_models;
+        }
+        if (!spilled && n_models <= collectors[0].max_models_in_memory) continue;
+        ModelRuns *runs = stage == STAGE_CNSD ? &collectors[0].cnsd_runs : &collectors[0].out1_runs;
+        for (int i = 0; i < n_threads; i++) {
+            ModelRuns *from = stage == STAGE_CNSD ? &collectors[i].cnsd_runs : &collectors[i].out1_runs;
+            spill_model_set(stage == STAGE_CNSD ? &collectors[i].cnsd : &collectors[i].out1, runs);
+            if (i == 0) continue;
+            for (int r = 0; r < from->n_runs; r++) add_model_run(runs, from->files[r]);
+            runs->n_duplicates += from->n_duplicates;
+        }
+    }
+    if (n_threads > 1) {
+        for (int i = 1; i < n_threads; i++) {
+            merge_model_sets(&collectors[0].cnsd, &collectors[i].cnsd);
+            merge_model_sets(&collectors[0].out1, &collectors[i].out1);
+            free_model_set(&collectors[i].cnsd);
+            free_model_set(&collectors[i].out1);
+        }
+        sort_model_set(&collectors[0].cnsd);
+        sort_model_set(&collectors[0].out1);
+    }
+    results.cnsd = collectors[0].cnsd;
+    results.out1 = collectors[0].out1;
+    results.cnsd_runs = collectors[0].cnsd_runs;
+    results.out1_runs = collectors[0].out1_runs;
+    free(collectors[0].program.clause_ids);
+    free(collectors);
+    free(contexts);
+    return results;
+}
+
+/* Free the model sets and runs held by a Results. */
+void free_results(Results *results) {
+    free_model_set(&results->cnsd);
+    free_model_set(&results->out1);
+    free_model_runs(&results->cnsd_runs);
+    free_model_runs(&results->out1_runs);
+}
+
+/* Function for counting the models of a stage of a Results, merging its
+ * runs when it was spilled; its duplicates are then all counted too. */
+uint64_t count_results_models(Results *results, Stage stage) {
+    ModelRuns *runs = stage == STAGE_CNSD ? &results->cnsd_runs : &results->out1_runs;
+    if (runs->n_runs > 0) return merge_model_runs(runs, NULL, NULL);
+    return (uint64_t)(stage == STAGE_CNSD ? results->cnsd.n_models : results->out1.n_models);
+}
+
+/* Function for computing cnsᵈ(R, A), i.e. the single stage cnsᵈ of compute_results. */
+Results cns_star(const CompiledRules *compiled, Atom *A, int n_facts, int n_threads) {
+    return compute_results(compiled, A, n_facts, STAGE_CNSD, n_threads, NULL, NULL, 0, NULL, NULL, NULL);
+}
+
+/* Function for computing out₁(R, A): the models M(D, A), D ∈ def(R), that
+ * satisfy all constraints in R. Constraints are checked during the search
+ * against the partial least models, so violating models are never built. */
+Results out(const CompiledRules *compiled, Atom *A, int n_facts, int n_threads) {
+    return compute_results(compiled, A, n_facts, STAGE_OUT1, n_threads, NULL, NULL, 0, NULL, NULL, NULL);
+}
+
+/* Function for finding the representative of an atom in a union-find
+ * forest, halving the path on the way. */
+int find_root(int *parent, int a) {
+    while (parent[a] != a) {
+        parent[a] = parent[parent[a]];
+        a = parent[a];
+    }
+    return a;
+}
+
+/* Function for splitting the rules of a knowledge base into the connected
+ * components of its atom graph, where the atoms of a rule (body and head)
+ * are connected. Least models of programs over disjoint atoms are unions
+ * of their least models, and constraints only see the atoms of their own
+ * component, so cnsᵈ(R,A) and out₁(R,A) are the products of those of the
+ * components, joined with the inert facts. Rules without atoms (⊢ ⊥, ⊣ ⊥)
+ * make components of their own. */
+Decomposition decompose_rules(const KnowledgeBase *kb) {
+    int n_atoms = kb->symbols.n_symbols;
+    int *parent = safe_malloc((n_atoms > 0 ? n_atoms : 1) * sizeof(int));
+    for (int a = 0; a < n_atoms; a++) {
+        parent[a] = a;
+    }
+    for (int i = 0; i < kb->n_rules; i++) {
+        const Rule *r = &kb->rules[i];
+        int first = -1;
+        for (int k = 0; k < r->n_atoms_in_body + r->n_atoms_in_head; k++) {
+            Atom a = k < r->n_atoms_in_body ? r->body[k] : r->head[k - r->n_atoms_in_body];
+            if (a == BOTTOM) continue;
+            if (first < 0) first = find_root(parent, a);
+            else parent[find_root(parent, a)] = first;
+            first = find_root(parent, first);
+        }
+    }
+    
+    /* Number the components in order of their first rule. */
+    int *component_of_root = safe_malloc((n_atoms > 0 ? n_atoms : 1) * sizeof(int));
+    int *component_of_rule = safe_malloc((kb->n_rules > 0 ? kb->n_rules : 1) * sizeof(int));
+    for (int a = 0; a < n_atoms; a++) {
+        component_of_root[a] = -1;
+    }
+    Decomposition decomposition;
+    decomposition.n_components = 0;
+    for (int i = 0; i < kb->n_rules; i++) {
+        const Rule *r = &kb->rules[i];
+        Atom a = r->n_atoms_in_body > 0 ? r->body[0] : r->head[0];
+        if (a == BOTTOM) {
+            component_of_rule[i] = decomposition.n_components++;
+            continue;
+        }
+        int root = find_root(parent, a);
+        if (component_of_root[root] < 0) component_of_root[root] = decomposition.n_components++;
+        component_of_rule[i] = component_of_root[root];
+    }
+    decomposition.components = safe_malloc((decomposition.n_components > 0 ? decomposition.n_components : 1) * sizeof(Component));
+    for (int c = 0; c < decomposition.n_components; c++) {
+        Component *component = &decomposition.components[c];
+        component->n_rules = 0;
+        component->n_atoms = 0;
+        component->n_facts = 0;
+    }
+    
+    /* Size the components, then number their atoms in increasing order. */
+    for (int i = 0; i < kb->n_rules; i++) {
+        decomposition.components[component_of_rule[i]].n_rules++;
+    }
+    int *local_ids = safe_malloc((n_atoms > 0 ? n_atoms : 1) * sizeof(int));
+    for (int a = 0; a < n_atoms; a++) {
+        int root = find_root(parent, a);
+        local_ids[a] = component_of_root[root] >= 0 ? decomposition.components[component_of_root[root]].n_atoms++ : -1;
+    }
+    for (int c = 0; c < decomposition.n_components; c++) {
+        Component *component = &decomposition.components[c];
+        component->rules = safe_malloc((component->n_rules > 0 ? component->n_rules : 1) * sizeof(Rule));
+        component->atoms = safe_malloc((component->n_atoms > 0 ? component->n_atoms : 1) * sizeof(Atom));
+        component->facts = safe_malloc((component->n_atoms > 0 ? component->n_atoms : 1) * sizeof(Atom));
+        component->n_rules = 0;
+    }
+    for (int a = 0; a < n_atoms; a++) {
+        if (local_ids[a] >= 0) decomposition.components[component_of_root[find_root(parent, a)]].atoms[local_ids[a]] = a;
+    }
+    
+    /* Copy the rules over the local IDs of their component. */
+    for (int i = 0; i < kb->n_rules; i++) {
+        const Rule *r = &kb->rules[i];
+        Component *component = &decomposition.components[component_of_rule[i]];
+        Rule *copy = &component->rules[component->n_rules++];
+        *copy = *r;
+        copy->body = safe_malloc((r->n_atoms_in_body > 0 ? r->n_atoms_in_body : 1) * sizeof(Atom));
+        copy->head = safe_malloc(r->n_atoms_in_head * sizeof(Atom));
+        for (int k = 0; k < r->n_atoms_in_body; k++) {
+            copy->body[k] = local_ids[r->body[k]];
+        }
+        for (int k = 0; k < r->n_atoms_in_head; k++) {
+            copy->head[k] = r->head[k] == BOTTOM ? BOTTOM : local_ids[r->head[k]];
+        }
+    }
+    
+    /* Hand every fact to its component, without repetitions; the others are inert. */
+    decomposition.inert_facts = safe_malloc((kb->n_facts > 0 ? kb->n_facts : 1) * sizeof(Atom));
+    decomposition.n_inert_facts = 0;
+    bool *seen = safe_malloc((n_atoms > 0 ? n_atoms : 1) * sizeof(bool));
+    memset(seen, 0, (n_atoms > 0 ? n_atoms : 1) * sizeof(bool));
+    for (int f = 0; f < kb->n_facts; f++) {
+        Atom a = kb->facts[f];
+        if (seen[a]) continue;
+        seen[a] = true;
+        if (local_ids[a] < 0) {
+            decomposition.inert_facts[decomposition.n_inert_facts++] = a;
+        } else {
+            Component *component = &decomposition.components[component_of_root[find_root(parent, a)]];
+            component->facts[component->n_facts++] = local_ids[a];
+        }
+    }
+    free(seen);
+    free(local_ids);
+    free(component_of_rule);
+    free(component_of_root);
+    free(parent);
+    return decomposition;
+}
+
+/* Function for compiling the rules of every component. */
+void compile_components(Decomposition *decomposition) {
+    for (int c = 0; c < decomposition->n_components; c++) {
+        Component *component = &decomposition->components[c];
+        component->compiled = compile_rules(component->rules, component->n_rules, component->n_atoms);
+    }
+}
+
+/* Function for computing cnsᵈ and out₁, as selected by stages, for every
+ * component on its own: the work is the sum of the searches of the
+ * components instead of a search over the product of all their choices. */
+void compute_component_results(Decomposition *decomposition, int stages, int n_threads) {
+    for (int c = 0; c < decomposition->n_components; c++) {
+        Component *component = &decomposition->components[c];
+        component->results = compute_results(&component->compiled, component->facts, component->n_facts,
+                                              stages & ~STAGE_DEF, n_threads, NULL, NULL, 0, NULL, NULL, NULL);
+    }
+}
+
+/* Function for counting the models of a stage as the product of the
+ * numbers of models of the components. */
+BigCount count_component_models(const Decomposition *decomposition, Stage stage) {
+    BigCount count;
+    init_bigcount(&count, 1);
+    for (int c = 0; c < decomposition->n_components; c++) {
+        const Results *results = &decomposition->components[c].results;
+        bigcount_multiply(&count, (uint32_t)(stage == STAGE_CNSD ? results->cnsd.n_models : results->out1.n_models));
+    }
+    return count;
+}
+
+/* Free the components of a decomposition, once compiled and computed. */
+void free_decomposition(Decomposition *decomposition) {
+    for (int c = 0; c < decomposition->n_components; c++) {
+        Component *component = &decomposition->components[c];
+        free_results(&component->results);
+        free_compiled_rules(&component->compiled);
+        free_rules(component->rules, component->n_rules);
+        free(component->atoms);
+        free(component->facts);
+    }
+    free(decomposition->components);
+    free(decomposition->inert_facts);
+}
+
+/* Function for the value of a literal under the assignment of a solver. */
+int literal_value(const Solver *solver, Literal l) {
+    int value = solver->values[l >> 1];
+    return value == VALUE_UNASSIGNED ? VALUE_UNASSIGNED : value ^ (l & 1);
+}
+
+/* Function for comparing literals, for qsort. */
+int compare_literals(const void *a, const void *b) {
+    Literal x = *(const Literal *)a, y = *(const Literal *)b;
+    return (x > y) - (x < y);
+}
+
+/* Function for moving a variable up the heap of a solver to its place. */
+void heap_sift_up(Solver *solver, int position) {
+    int var = solver->heap[position];
+    while (position > 0) {
+        int parent = (position - 1) / 2;
+        if (solver->activity[solver->heap[parent]] >= solver->activity[var]) break;
+        solver->heap[position] = solver->heap[parent];
+        solver->heap_positions[solver->heap[position]] = position;
+        position = parent;
+    }
+    solver->heap[position] = var;
+    solver->heap_positions[var] = position;
+}
+
+/* Function for moving a variable down the heap of a solver to its place. */
+void heap_sift_down(Solver *solver, int position) {
+    int var = solver->heap[position];
+    while (2 * position + 1 < solver->n_heap) {
+        int child = 2 * position + 1;
+        if (child + 1 < solver->n_heap && solver->activity[solver->heap[child + 1]] > solver->activity[solver->heap[child]]) child++;
+        if (solver->activity[solver->heap[child]] <= solver->activity[var]) break;
+        solver->heap[position] = solver->heap[child];
+        solver->heap_positions[solver->heap[position]] = position;
+        position = child;
+    }
+    solver->heap[position] = var;
+    solver->heap_positions[var] = position;
+}
+
+/* Function for adding a variable to the heap of a solver, unless it is there. */
+void heap_insert(Solver *solver, int var) {
+    if (solver->heap_positions[var] >= 0) return;
+    solver->heap[solver->n_heap] = var;
+    solver->heap_positions[var] = solver->n_heap++;
+    heap_sift_up(solver, solver->n_heap - 1);
+}
+
+/* Function for removing the most active variable from the heap of a solver. */
+int heap_pop(Solver *solver) {
+    int var = solver->heap[0];
+    solver->heap_positions[var] = -1;
+    if (--solver->n_heap > 0) {
+        solver->heap[0] = solver->heap[solver->n_heap];
+        heap_sift_down(solver, 0);
+    }
+    return var;
+}
+
+/* Function for bumping the activity of a variable met in a conflict,
+ * rescaling all activities when they grow too large. */
+void bump_activity(Solver *solver, int var) {
+    if ((solver->activity[var] += solver->activity_increment) > 1e100) {
+        for (int v = 0; v < solver->n_vars; v++) {
+            solver->activity[v] *= 1e-100;
+        }
+        solver->activity_increment *= 1e-100;
+    }
+    if (solver->heap_positions[var] >= 0) heap_sift_up(solver, solver->heap_positions[var]);
+}
+
+/* Function for making a clause watch a literal. */
+void watch_literal(Solver *solver, Literal l, int clause) {
+    if (solver->n_watches[l] == solver->watch_capacity[l]) {
+        solver->watch_capacity[l] = solver->watch_capacity[l] > 0 ? 2 * solver->watch_capacity[l] : 4;
+        solver->watches[l] = safe_realloc(solver->watches[l], solver->watch_capacity[l] * sizeof(int));
+    }
+    solver->watches[l][solver->n_watches[l]++] = clause;
+}
+
+/* Function for storing a clause of at least two literals, watching its
+ * first two. Returns its offset. */
+int store_clause(Solver *solver, const Literal *literals, int n_literals) {
+    if (solver->n_clause_ints + n_literals + 1 > solver->clause_capacity) {
+        while (solver->n_clause_ints + n_literals + 1 > solver->clause_capacity) solver->clause_capacity *= 2;
+        solver->clauses = safe_realloc(solver->clauses, solver->clause_capacity * sizeof(int));
+    }
+    int clause = (int)solver->n_clause_ints;
+    solver->clauses[clause] = n_literals;
+    memcpy(&solver->clauses[clause + 1], literals, n_literals * sizeof(Literal));
+    solver->n_clause_ints += n_literals + 1;
+    watch_literal(solver, literals[0], clause);
+    watch_literal(solver, literals[1], clause);
+    return clause;
+}
+
+/* Function for assigning a literal at the current level, for a reason
+ * clause (-1 for decisions and units). */
+void assign_literal(Solver *solver, Literal l, int reason) {
+    int var = l >> 1;
+    solver->values[var] = (l & 1) ? VALUE_FALSE : VALUE_TRUE;
+    solver->levels[var] = solver->n_levels;
+    solver->reasons[var] = reason;
+    solver->trail[solver->n_trail++] = l;
+}
+
+/* Function for adding a clause to a solver at level 0. Its literals are
+ * sorted in place; repeated literals and literals false at level 0 are
+ * dropped, and tautologies and satisfied clauses are ignored. An empty
+ * clause makes the solver unsatisfiable, a unit clause is assigned. */
+void add_clause(Solver *solver, Literal *literals, int n_literals) {
+    qsort(literals, n_literals, sizeof(Literal), compare_literals);
+    int size = 0;
+    Literal previous = -1;
+    for (int i = 0; i < n_literals; i++) {
+        Literal l = literals[i];
+        if (l == previous) continue;
+        if (l == (previous ^ 1)) return;
+        previous = l;
+        int value = literal_value(solver, l);
+        if (value == VALUE_TRUE) return;
+        if (value == VALUE_UNASSIGNED) literals[size++] = l;
+    }
+    if (size == 0) solver->unsatisfiable = true;
+    else if (size == 1) assign_literal(solver, literals[0], -1);
+    else store_clause(solver, literals, size);
+}
+
+/* Function for propagating the assigned literals of a solver through the
+ * watched clauses: a clause whose literals are all false but one has it
+ * assigned. Returns the offset of a clause found false, or -1. */
+int propagate(Solver *solver) {
+    while (solver->n_propagated < solver->n_trail) {
+        Literal false_literal = solver->trail[solver->n_propagated++] ^ 1;
+        int *watch = solver->watches[false_literal];
+        int n_watch = solver->n_watches[false_literal], n_kept = 0;
+        for (int i = 0; i < n_watch; i++) {
+            int clause = watch[i];
+            int size = solver->clauses[clause];
+            Literal *literals = &solver->clauses[clause + 1];
+            if (literals[0] == false_literal) {
+                literals[0] = literals[1];
+                literals[1] = false_literal;
+            }
+            if (literal_value(solver, literals[0]) == VALUE_TRUE) {
+                watch[n_kept++] = clause;
+                continue;
+            }
+            
+            /* Look for another literal to watch. */
+            int k = 2;
+            while (k < size && literal_value(solver, literals[k]) == VALUE_FALSE) k++;
+            if (k < size) {
+                literals[1] = literals[k];
+                literals[k] = false_literal;
+                watch_literal(solver, literals[1], clause);
+                continue;
+            }
+            watch[n_kept++] = clause;
+            if (literal_value(solver, literals[0]) == VALUE_FALSE) {
+                while (++i < n_watch) watch[n_kept++] = watch[i];
+                solver->n_watches[false_literal] = n_kept;
+                return clause;
+            }
+            assign_literal(solver, literals[0], clause);
+        }
+        solver->n_watches[false_literal] = n_kept;
+    }
+    return -1;
+}
+
+/* Function for learning a clause from a conflict (first unique implication
+ * point): the literals of the current level are resolved away along their
+ * reasons until one is left, which goes first in solver->learnt, the
+ * literal of the highest other level going second. Returns the number of
+ * literals learnt, and the level to jump back to in backjump_level. */
+int analyze_conflict(Solver *solver, int conflict, int *backjump_level) {
+    int n_learnt = 1, n_pending = 0, index = solver->n_trail - 1;
+    Literal l = -1;
+    do {
+        int size = solver->clauses[conflict];
+        const Literal *literals = &solver->clauses[conflict + 1];
+        for (int k = l < 0 ? 0 : 1; k < size; k++) {
+            int var = literals[k] >> 1;
+            if (solver->seen[var] || solver->levels[var] == 0) continue;
+            solver->seen[var] = true;
+            bump_activity(solver, var);
+            if (solver->levels[var] == solver->n_levels) n_pending++;
+            else solver->learnt[n_learnt++] = literals[k];
+        }
+        while (!solver->seen[solver->trail[index] >> 1]) index--;
+        l = solver->trail[index--];
+        conflict = solver->reasons[l >> 1];
+        solver->seen[l >> 1] = false;
+    } while (--n_pending > 0);
+    solver->learnt[0] = l ^ 1;
+    *backjump_level = 0;
+    for (int k = 1; k < n_learnt; k++) {
+        int var = solver->learnt[k] >> 1;
+        solver->seen[var] = false;
+        if (solver->levels[var] > *backjump_level) {
+            *backjump_level = solver->levels[var];
+            Literal first = solver->learnt[1];
+            solver->learnt[1] = solver->learnt[k];
+            solver->learnt[k] = first;
+        }
+    }
+    return n_learnt;
+}
+
+/* Function for undoing the assignments of a solver above a level, saving
+ * the signs of the variables for their next decisions. */
+void backtrack(Solver *solver, int level) {
+    if (solver->n_levels <= level) return;
+    for (int i = solver->n_trail - 1; i >= solver->trail_limits[level]; i--) {
+        int var = solver->trail[i] >> 1;
+        solver->phases[var] = solver->values[var] == VALUE_TRUE;
+        solver->values[var] = VALUE_UNASSIGNED;
+        heap_insert(solver, var);
+    }
+    solver->n_trail = solver->trail_limits[level];
+    solver->n_propagated = solver->n_trail;
+    solver->n_levels = level;
+}
+
+/* Function for flipping the decision of the last level of a solver, once
+ * the assignments under it are exhausted: the level is undone and the
+ * negated decision is assigned at the level below, with no reason, which
+ * becomes the backtrack level. Assumptions are not flipped. Returns false
+ * if the last level is an assumption, nothing being left to search. */
+bool flip_decision(Solver *solver, int n_assumptions) {
+    int level = solver->n_levels;
+    if (level <= n_assumptions) return false;
+    Literal decision = solver->trail[solver->trail_limits[level - 1]];
+    backtrack(solver, level - 1);
+    assign_literal(solver, decision ^ 1, -1);
+    solver->backtrack_level = level - 1;
+    return true;
+}
+
+/* Function for searching a total assignment satisfying the clauses of a
+ * solver, from its current assignment, in which the assumed literals hold:
+ * assumption i is decided at level i + 1 (an empty level if it already
+ * holds), then the most active variable, propagating each decision, and on
+ * a conflict a clause is learnt and the search jumps back. Learnt clauses
+ * follow from the clauses alone, so they are kept for later searches
+ * under other assumptions. The search restarts from level 0 (the backtrack
+ * level) after every 100 conflicts, then 50% more each time. A conflict at
+ * or below the backtrack level flips the last decision instead. Returns
+ * false if there is no such assignment; the solver is left unsatisfiable
+ * if there is none even without the assumptions. */
+bool solve(Solver *solver, const Literal *assumptions, int n_assumptions) {
+    if (solver->unsatisfiable) return false;
+    uint64_t n_conflicts = 0, restart_limit = 100;
+    while (true) {
+        int conflict = propagate(solver);
+        if (conflict >= 0) {
+            STATS_ADD(solver_conflicts, 1);
+            if (solver->n_levels == 0) {
+                solver->unsatisfiable = true;
+                return false;
+            }
+            if (solver->n_levels <= solver->backtrack_level) {
+                if (!flip_decision(solver, n_assumptions)) return false;
+                continue;
+            }
+            int level;
+            int n_learnt = analyze_conflict(solver, conflict, &level);
+            backtrack(solver, level > solver->backtrack_level ? level : solver->backtrack_level);
+            assign_literal(solver, solver->learnt[0], n_learnt > 1 ? store_clause(solver, solver->learnt, n_learnt) : -1);
+            solver->activity_increment /= 0.95;
+            if (++n_conflicts == restart_limit) {
+                backtrack(solver, solver->backtrack_level);
+                restart_limit += restart_limit / 2;
+                n_conflicts = 0;
+            }
+            continue;
+        }
+        if (solver->n_levels < n_assumptions) {
+            Literal assumption = assumptions[solver->n_levels];
+            int value = literal_value(solver, assumption);
+            if (value == VALUE_FALSE) return false;
+            solver->trail_limits[solver->n_levels++] = solver->n_trail;
+            if (value == VALUE_UNASSIGNED) assign_literal(solver, assumption, -1);
+            continue;
+        }
+        int var = -1;
+        while (solver->n_heap > 0 && var < 0) {
+            int candidate = heap_pop(solver);
+            if (solver->values[candidate] == VALUE_UNASSIGNED) var = candidate;
+        }
+        if (var < 0) return true;
+        STATS_ADD(solver_decisions, 1);
+        solver->trail_limits[solver->n_levels++] = solver->n_trail;
+        assign_literal(solver, 2 * var + !solver->phases[var], -1);
+    }
+}
+
+/* Function for adding a variable to a solver, unassigned and with no
+ * clause, growing its arrays when they are full. Returns the variable. */
+int add_solver_variable(Solver *solver) {
+    if (solver->n_vars == solver->var_capacity) {
+        int old_capacity = solver->var_capacity, capacity = 2 * old_capacity;
+        solver->watches = safe_realloc(solver->watches, 2 * capacity * sizeof(int *));
+        solver->n_watches = safe_realloc(solver->n_watches, 2 * capacity * sizeof(int));
+        solver->watch_capacity = safe_realloc(solver->watch_capacity, 2 * capacity * sizeof(int));
+        for (int l = 2 * old_capacity; l < 2 * capacity; l++) {
+            solver->watches[l] = NULL;
+            solver->n_watches[l] = 0;
+            solver->watch_capacity[l] = 0;
+        }
+        solver->values = safe_realloc(solver->values, capacity * sizeof(signed char));
+        solver->levels = safe_realloc(solver->levels, capacity * sizeof(int));
+        solver->reasons = safe_realloc(solver->reasons, capacity * sizeof(int));
+        solver->trail = safe_realloc(solver->trail, capacity * sizeof(Literal));
+        solver->trail_limits = safe_realloc(solver->trail_limits, (2 * capacity + 1) * sizeof(int));
+        solver->activity = safe_realloc(solver->activity, capacity * sizeof(double));
+        solver->heap = safe_realloc(solver->heap, capacity * sizeof(int));
+        solver->heap_positions = safe_realloc(solver->heap_positions, capacity * sizeof(int));
+        solver->phases = safe_realloc(solver->phases, capacity * sizeof(bool));
+        solver->seen = safe_realloc(solver->seen, capacity * sizeof(bool));
+        solver->learnt = safe_realloc(solver->learnt, (capacity + 1) * sizeof(Literal));
+        solver->var_capacity = capacity;
+    }
+    int var = solver->n_vars++;
+    solver->values[var] = VALUE_UNASSIGNED;
+    solver->activity[var] = 0;
+    solver->heap_positions[var] = -1;
+    solver->phases[var] = false;
+    solver->seen[var] = false;
+    heap_insert(solver, var);
+    return var;
+}
+
+/* Function for allocating a solver whose variables are n_atoms atoms, with
+ * room for capacity variables, and with no rule and no clause. */
+Solver empty_solver(int n_atoms, int capacity) {
+    Solver solver;
+    solver.var_capacity = capacity > 0 ? capacity : 1;
+    solver.rules = NULL;
+    solver.n_rules = 0;
+    solver.n_atoms = n_atoms;
+    solver.n_vars = 0;
+    solver.body_literals = NULL;
+    solver.watch_start = NULL;
+    solver.watch_rules = NULL;
+    solver.head_start = NULL;
+    solver.head_rules = NULL;
+    solver.loop_guard = -1;
+    solver.clause_capacity = 1024;
+    solver.n_clause_ints = 0;
+    solver.clauses = safe_malloc(solver.clause_capacity * sizeof(int));
+    solver.watches = safe_malloc(2 * solver.var_capacity * sizeof(int *));
+    solver.n_watches = safe_malloc(2 * solver.var_capacity * sizeof(int));
+    solver.watch_capacity = safe_malloc(2 * solver.var_capacity * sizeof(int));
+    for (int l = 0; l < 2 * solver.var_capacity; l++) {
+        solver.watches[l] = NULL;
+        solver.n_watches[l] = 0;
+        solver.watch_capacity[l] = 0;
+    }
+    solver.values = safe_malloc(solver.var_capacity * sizeof(signed char));
+    solver.levels = safe_malloc(solver.var_capacity * sizeof(int));
+    solver.reasons = safe_malloc(solver.var_capacity * sizeof(int));
+    solver.trail = safe_malloc(solver.var_capacity * sizeof(Literal));
+    solver.trail_limits = safe_malloc((2 * solver.var_capacity + 1) * sizeof(int));
+    solver.activity = safe_malloc(solver.var_capacity * sizeof(double));
+    solver.heap = safe_malloc(solver.var_capacity * sizeof(int));
+    solver.heap_positions = safe_malloc(solver.var_capacity * sizeof(int));
+    solver.phases = safe_malloc(solver.var_capacity * sizeof(bool));
+    solver.seen = safe_malloc(solver.var_capacity * sizeof(bool));
+    solver.learnt = safe_malloc((solver.var_capacity + 1) * sizeof(Literal));
+    solver.n_trail = 0;
+    solver.n_propagated = 0;
+    solver.n_levels = 0;
+    solver.backtrack_level = 0;
+    solver.n_heap = 0;
+    solver.activity_increment = 1;
+    solver.unsatisfiable = false;
+    for (int a = 0; a < n_atoms; a++) {
+        add_solver_variable(&solver);
+    }
+    return solver;
+}
+
+/* Function for the literal standing for the body of a rule in a solver: -1
+ * for a constraint, the atom of a body of one atom, or else a new body
+ * variable, whose definition add_rule_clauses adds. */
+Literal new_body_literal(Solver *solver, const Rule *r) {
+    if (is_constraint(*r)) return -1;
+    if (r->n_atoms_in_body == 1) return 2 * r->body[0];
+    return 2 * add_solver_variable(solver);
+}
+
+/* Function for indexing the rules of a solver by body atom and by head
+ * atom (but ⊥), replacing the indexes it had. */
+void index_solver_rules(Solver *solver) {
+    const Rule *rules = solver->rules;
+    int n_rules = solver->n_rules, n_atoms = solver->n_atoms;
+    free(solver->watch_start);
+    free(solver->watch_rules);
+    free(solver->head_start);
+    free(solver->head_rules);
+    solver->watch_start = safe_malloc((n_atoms + 1) * sizeof(int));
+    solver->head_start = safe_malloc((n_atoms + 1) * sizeof(int));
+    memset(solver->watch_start, 0, (n_atoms + 1) * sizeof(int));
+    memset(solver->head_start, 0, (n_atoms + 1) * sizeof(int));
+    for (int i = 0; i < n_rules; i++) {
+        for (int k = 0; k < rules[i].n_atoms_in_body; k++) {
+            solver->watch_start[rules[i].body[k] + 1]++;
+        }
+        for (int k = 0; k < rules[i].n_atoms_in_head; k++) {
+            if (rules[i].head[k] != BOTTOM) solver->head_start[rules[i].head[k] + 1]++;
+        }
+    }
+    for (int a = 0; a < n_atoms; a++) {
+        solver->watch_start[a + 1] += solver->watch_start[a];
+        solver->head_start[a + 1] += solver->head_start[a];
+    }
+    solver->watch_rules = safe_malloc((solver->watch_start[n_atoms] > 0 ? solver->watch_start[n_atoms] : 1) * sizeof(int));
+    solver->head_rules = safe_malloc((solver->head_start[n_atoms] > 0 ? solver->head_start[n_atoms] : 1) * sizeof(int));
+    int *watch_fill = safe_malloc((n_atoms + 1) * sizeof(int));
+    int *head_fill = safe_malloc((n_atoms + 1) * sizeof(int));
+    memcpy(watch_fill, solver->watch_start, (n_atoms + 1) * sizeof(int));
+    memcpy(head_fill, solver->head_start, (n_atoms + 1) * sizeof(int));
+    for (int i = 0; i < n_rules; i++) {
+        for (int k = 0; k < rules[i].n_atoms_in_body; k++) {
+            solver->watch_rules[watch_fill[rules[i].body[k]]++] = i;
+        }
+        for (int k = 0; k < rules[i].n_atoms_in_head; k++) {
+            if (rules[i].head[k] != BOTTOM) solver->head_rules[head_fill[rules[i].head[k]]++] = i;
+        }
+    }
+    free(watch_fill);
+    free(head_fill);
+}
+
+/* Function for adding the clauses of rule i to a solver at level 0: the
+ * definition of its body variable, if it has one, then for an imperative
+ * rule a head atom when the body holds, and for a constraint of out₁ its
+ * body not holding. These last clauses only apply while guard holds, if
+ * guard is not -1. */
+void add_rule_clauses(Solver *solver, int i, Stage stage, Literal guard) {
+    const Rule *r = &solver->rules[i];
+    Literal body = solver->body_literals[i];
+    Literal *literals = safe_malloc((r->n_atoms_in_body + r->n_atoms_in_head + 2) * sizeof(Literal));
+    if (body >= 2 * solver->n_atoms) {
+        for (int k = 0; k < r->n_atoms_in_body; k++) {
+            literals[0] = body ^ 1;
+            literals[1] = 2 * r->body[k];
+            add_clause(solver, literals, 2);
+        }
+        literals[0] = body;
+        for (int k = 0; k < r->n_atoms_in_body; k++) {
+            literals[k + 1] = 2 * r->body[k] + 1;
+        }
+        add_clause(solver, literals, r->n_atoms_in_body + 1);
+    }
+    int n = -1;
+    if (body < 0 && stage == STAGE_OUT1) {
+        n = 0;
+        for (int k = 0; k < r->n_atoms_in_body; k++) {
+            literals[n++] = 2 * r->body[k] + 1;
+        }
+    } else if (body >= 0 && r->ruletype == IMPERATIVE) {
+        n = 0;
+        literals[n++] = body ^ 1;
+        for (int k = 0; k < r->n_atoms_in_head; k++) {
+            if (r->head[k] != BOTTOM) literals[n++] = 2 * r->head[k];
+        }
+    }
+    if (n >= 0) {
+        if (guard >= 0) literals[n++] = guard ^ 1;
+        add_clause(solver, literals, n);
+    }
+    free(literals);
+}
+
+/* Function for adding the support clause of an atom that is not a fact to
+ * a solver at level 0: it needs a rule deriving it, whose body holds. The
+ * clause only applies while guard holds, if guard is not -1. */
+void add_support_clause(Solver *solver, Atom a, Literal guard) {
+    Literal *literals = safe_malloc((solver->head_start[a + 1] - solver->head_start[a] + 2) * sizeof(Literal));
+    int n = 0;
+    literals[n++] = 2 * a + 1;
+    for (int j = solver->head_start[a]; j < solver->head_start[a + 1]; j++) {
+        if (solver->body_literals[solver->head_rules[j]] >= 0) literals[n++] = solver->body_literals[solver->head_rules[j]];
+    }
+    if (guard >= 0) literals[n++] = guard ^ 1;
+    add_clause(solver, literals, n);
+    free(literals);
+}
+
+/* Function for building the solver of a stage (cnsᵈ or out₁) of a
+ * knowledge base. Its clauses hold exactly for the supported models M of
+ * the rules: the facts are in M; the body variable of a rule holds iff its
+ * body is in M; an imperative rule whose body is in M has a head atom in M;
+ * an atom of M that is not a fact is in the head of a rule whose body is
+ * in M; and for out₁, no constraint has its body in M. The models in
+ * cnsᵈ(R,A) are the supported models that are also founded, which is
+ * checked separately (find_unfounded_atoms). */
+Solver new_solver(const KnowledgeBase *kb, Stage stage) {
+    int n_rules = kb->n_rules, n_atoms = kb->symbols.n_symbols;
+    Solver solver = empty_solver(n_atoms, n_atoms + n_rules);
+    solver.rules = kb->rules;
+    solver.n_rules = n_rules;
+    solver.body_literals = safe_malloc((n_rules > 0 ? n_rules : 1) * sizeof(Literal));
+    for (int i = 0; i < n_rules; i++) {
+        solver.body_literals[i] = new_body_literal(&solver, &kb->rules[i]);
+    }
+    index_solver_rules(&solver);
+    for (int f = 0; f < kb->n_facts; f++) {
+        Literal fact = 2 * kb->facts[f];
+        add_clause(&solver, &fact, 1);
+    }
+    for (int i = 0; i < n_rules; i++) {
+        add_rule_clauses(&solver, i, stage, -1);
+    }
+    
+    /* Support: an atom that is not a fact needs a rule deriving it. */
+    bool *is_fact = safe_malloc((n_atoms > 0 ? n_atoms : 1) * sizeof(bool));
+    memset(is_fact, 0, (n_atoms > 0 ? n_atoms : 1) * sizeof(bool));
+    for (int f = 0; f < kb->n_facts; f++) {
+        is_fact[kb->facts[f]] = true;
+    }
+    for (Atom a = 0; a < n_atoms; a++) {
+        if (!is_fact[a]) add_support_clause(&solver, a, -1);
+    }
+    free(is_fact);
+    return solver;
+}
+
+/* Function for renumbering the atoms of a solver at level 0 once atoms
+ * were interned and the symbols sorted again, its rules being renumbered
+ * already: atom a becomes renumber[a], n_atoms - solver->n_atoms new atoms
+ * take the numbers left, and the other variables move up by as many. The
+ * rules are indexed again. */
+void renumber_solver_atoms(Solver *solver, const Atom *renumber, int n_atoms) {
+    int n_old_atoms = solver->n_atoms, n_old_vars = solver->n_vars, n_new = n_atoms - n_old_atoms;
+    for (int k = 0; k < n_new; k++) {
+        add_solver_variable(solver);
+    }
+    int n_vars = solver->n_vars;
+    int *map = safe_malloc(n_vars * sizeof(int));
+    bool *taken = safe_malloc((n_atoms > 0 ? n_atoms : 1) * sizeof(bool));
+    memset(taken, 0, (n_atoms > 0 ? n_atoms : 1) * sizeof(bool));
+    for (int v = 0; v < n_old_vars; v++) {
+        map[v] = v < n_old_atoms ? (int)renumber[v] : v + n_new;
+        if (v < n_old_atoms) taken[map[v]] = true;
+    }
+    Atom next = 0;
+    for (int v = n_old_vars; v < n_vars; v++) {
+        while (taken[next]) next++;
+        map[v] = next++;
+    }
+    free(taken);
+    
+    /* Move the values and watches of every variable to its new number. */
+    signed char *values = safe_malloc(n_vars * sizeof(signed char));
+    int *levels = safe_malloc(n_vars * sizeof(int)), *reasons = safe_malloc(n_vars * sizeof(int));
+    double *activity = safe_malloc(n_vars * sizeof(double));
+    bool *phases = safe_malloc(n_vars * sizeof(bool));
+    int **watches = safe_malloc(2 * n_vars * sizeof(int *));
+    int *n_watches = safe_malloc(2 * n_vars * sizeof(int)), *watch_capacity = safe_malloc(2 * n_vars * sizeof(int));
+    for (int v = 0; v < n_vars; v++) {
+        values[map[v]] = solver->values[v];
+        levels[map[v]] = solver->levels[v];
+        reasons[map[v]] = solver->reasons[v];
+        activity[map[v]] = solver->activity[v];
+        phases[map[v]] = solver->phases[v];
+        for (int sign = 0; sign < 2; sign++) {
+            watches[2 * map[v] + sign] = solver->watches[2 * v + sign];
+            n_watches[2 * map[v] + sign] = solver->n_watches[2 * v + sign];
+            watch_capacity[2 * map[v] + sign] = solver->watch_capacity[2 * v + sign];
+        }
+    }
+    memcpy(solver->values, values, n_vars * sizeof(signed char));
+    memcpy(solver->levels, levels, n_vars * sizeof(int));
+    memcpy(solver->reasons, reasons, n_vars * sizeof(int));
+    memcpy(solver->activity, activity, n_vars * sizeof(double));
+    memcpy(solver->phases, phases, n_vars * sizeof(bool));
+    memcpy(solver->watches, watches, 2 * n_vars * sizeof(int *));
+    memcpy(solver->n_watches, n_watches, 2 * n_vars * sizeof(int));
+    memcpy(solver->watch_capacity, watch_capacity, 2 * n_vars * sizeof(int));
+    free(watch_capacity);
+    free(n_watches);
+    free(watches);
+    free(phases);
+    free(activity);
+    free(reasons);
+    free(levels);
+    free(values);
+    
+    /* Rename the literals of the clauses, the trail and the rule bodies. */
+    for (size_t c = 0; c < solver->n_clause_ints; c += solver->clauses[c] + 1) {
+        for (int k = 1; k <= solver->clauses[c]; k++) {
+            Literal l = solver->clauses[c + k];
+            solver->clauses[c + k] = 2 * map[l >> 1] + (l & 1);
+        }
+    }
+    for (int i = 0; i < solver->n_trail; i++) {
+        solver->trail[i] = 2 * map[solver->trail[i] >> 1] + (solver->trail[i] & 1);
+    }
+    for (int i = 0; i < solver->n_rules; i++) {
+        if (solver->body_literals[i] >= 0) solver->body_literals[i] = 2 * map[solver->body_literals[i] >> 1] + (solver->body_literals[i] & 1);
+    }
+    if (solver->loop_guard >= 0) solver->loop_guard += 2 * n_new;
+    free(map);
+    solver->n_heap = 0;
+    for (int v = 0; v < n_vars; v++) {
+        solver->heap_positions[v] = -1;
+    }
+    for (int v = 0; v < n_vars; v++) {
+        if (solver->values[v] == VALUE_UNASSIGNED) heap_insert(solver, v);
+    }
+    solver->n_atoms = n_atoms;
+    index_solver_rules(solver);
+}
+
+/* Function for dropping the clauses of a solver satisfied at level 0, such
+ * as those of retired selectors, once the level 0 assignment propagated.
+ * The clauses left are packed and watched again; the reasons of level 0,
+ * which are never looked at, are cleared. */
+void remove_satisfied_clauses(Solver *solver) {
+    if (propagate(solver) >= 0) {
+        solver->unsatisfiable = true;
+        return;
+    }
+    size_t n_kept = 0, c = 0;
+    while (c < solver->n_clause_ints) {
+        int size = solver->clauses[c];
+        bool satisfied = false;
+        for (int k = 1; k <= size && !satisfied; k++) {
+            satisfied = literal_value(solver, solver->clauses[c + k]) == VALUE_TRUE;
+        }
+        if (!satisfied) {
+            memmove(&solver->clauses[n_kept], &solver->clauses[c], (size + 1) * sizeof(int));
+            n_kept += size + 1;
+        }
+        c += size + 1;
+    }
+    solver->n_clause_ints = n_kept;
+    for (int l = 0; l < 2 * solver->n_vars; l++) {
+        solver->n_watches[l] = 0;
+    }
+    for (size_t c = 0; c < solver->n_clause_ints; c += solver->clauses[c] + 1) {
+        watch_literal(solver, solver->clauses[c + 1], (int)c);
+        watch_literal(solver, solver->clauses[c + 2], (int)c);
+    }
+    for (int i = 0; i < solver->n_trail; i++) {
+        solver->reasons[solver->trail[i] >> 1] = -1;
+    }
+}
+
+/* Free the clauses, watches and assignment of a solver. */
+void free_solver(Solver *solver) {
+    for (int l = 0; l < 2 * solver->var_capacity; l++) {
+        free(solver->watches[l]);
+    }
+    free(solver->watches);
+    free(solver->n_watches);
+    free(solver->watch_capacity);
+    free(solver->clauses);
+    free(solver->body_literals);
+    free(solver->watch_start);
+    free(solver->watch_rules);
+    free(solver->head_start);
+    free(solver->head_rules);
+    free(solver->values);
+    free(solver->levels);
+    free(solver->reasons);
+    free(solver->trail);
+    free(solver->trail_limits);
+    free(solver->activity);
+    free(solver->heap);
+    free(solver->heap_positions);
+    free(solver->phases);
+    free(solver->seen);
+    free(solver->learnt);
+}
+
+/* Function for deriving the head atoms of a rule (but ⊥) that belong to the
+ * model M assigned by a solver, for find_unfounded_atoms. */
+void derive_founded_heads(const Solver *solver, int rule, bool *derived, Atom *queue, int *n_queued) {
+    if (solver->body_literals[rule] < 0) return;
+    const Rule *r = &solver->rules[rule];
+    for (int k = 0; k < r->n_atoms_in_head; k++) {
+        Atom h = r->head[k];
+        if (h != BOTTOM && !derived[h] && solver->values[h] == VALUE_TRUE) {
+            derived[h] = true;
+            queue[(*n_queued)++] = h;
+        }
+    }
+}
+
+/* Function for finding the atoms of the model M assigned by a solver that
+ * are not founded: those not derived from the facts by the rules whose
+ * body is in M, through their head atoms in M. M is in cnsᵈ(R,A), as the
+ * least model of the program choosing the head atoms in M of every rule,
+ * iff there are none. Returns their number, listing them in unfounded. */
+int find_unfounded_atoms(const Solver *solver, const Atom *facts, int n_facts, Atom *unfounded) {
+    int n_atoms = solver->n_atoms;
+    int *missing = safe_malloc((solver->n_rules > 0 ? solver->n_rules : 1) * sizeof(int));
+    bool *derived = safe_malloc((n_atoms > 0 ? n_atoms : 1) * sizeof(bool));
+    Atom *queue = safe_malloc((n_atoms > 0 ? n_atoms : 1) * sizeof(Atom));
+    memset(derived, 0, (n_atoms > 0 ? n_atoms : 1) * sizeof(bool));
+    int n_queued = 0;
+    for (int f = 0; f < n_facts; f++) {
+        if (!derived[facts[f]]) {
+            derived[facts[f]] = true;
+            queue[n_queued++] = facts[f];
+        }
+    }
+    for (int i = 0; i < solver->n_rules; i++) {
+        missing[i] = solver->rules[i].n_atoms_in_body;
+        if (missing[i] == 0) derive_founded_heads(solver, i, derived, queue, &n_queued);
+    }
+    for (int next = 0; next < n_queued; next++) {
+        Atom a = queue[next];
+        for (int w = solver->watch_start[a]; w < solver->watch_start[a + 1]; w++) {
+            if (--missing[solver->watch_rules[w]] == 0) derive_founded_heads(solver, solver->watch_rules[w], derived, queue, &n_queued);
+        }
+    }
+    int n_unfounded = 0;
+    for (Atom a = 0; a < n_atoms; a++) {
+        if (solver->values[a] == VALUE_TRUE && !derived[a]) unfounded[n_unfounded++] = a;
+    }
+    free(queue);
+    free(derived);
+    free(missing);
+    return n_unfounded;
+}
+
+/* Function for adding the loop formulas of a set of unfounded atoms U to
+ * a solver at level 0: an atom of U needs a rule having a head atom in U
+ * whose body, having no atom in U, is in the model. They are guarded by
+ * the loop guard of the solver, if any. */
+void add_loop_formulas(Solver *solver, const Atom *unfounded, int n_unfounded) {
+    STATS_ADD(loop_formulas, n_unfounded);
+    bool *in_set = safe_malloc((solver->n_atoms > 0 ? solver->n_atoms : 1) * sizeof(bool));
+    memset(in_set, 0, (solver->n_atoms > 0 ? solver->n_atoms : 1) * sizeof(bool));
+    for (int u = 0; u < n_unfounded; u++) {
+        in_set[unfounded[u]] = true;
+    }
+    Literal *literals = safe_malloc((solver->n_rules + 1) * sizeof(Literal));
+    int n_external = 0;
+    for (int i = 0; i < solver->n_rules; i++) {
+        const Rule *r = &solver->rules[i];
+        if (solver->body_literals[i] < 0) continue;
+        bool into = false, from = false;
+        for (int k = 0; k < r->n_atoms_in_head; k++) {
+            if (r->head[k] != BOTTOM && in_set[r->head[k]]) into = true;
+        }
+        for (int k = 0; k < r->n_atoms_in_body; k++) {
+            if (in_set[r->body[k]]) from = true;
+        }
+        if (into && !from) literals[1 + n_external++] = solver->body_literals[i];
+    }
+    Literal *clause = safe_malloc((n_external + 2) * sizeof(Literal));
+    for (int u = 0; u < n_unfounded; u++) {
+        int n = 0;
+        clause[n++] = 2 * unfounded[u] + 1;
+        memcpy(clause + n, literals + 1, n_external * sizeof(Literal));
+        n += n_external;
+        if (solver->loop_guard >= 0) clause[n++] = solver->loop_guard ^ 1;
+        add_clause(solver, clause, n);
+    }
+    free(clause);
+    free(literals);
+    free(in_set);
+}
+
+/* Function for finding a model of the stage of a solver in which the
+ * assumed literals hold: every supported model the solver finds is either
+ * founded, and then copied to model, or refuted by the loop formulas of
+ * its unfounded atoms, listed in the buffer unfounded. The solver is left
+ * at level 0. Returns false if there is no such model. */
+bool find_founded_model(Solver *solver, const KnowledgeBase *kb, const Literal *assumptions, int n_assumptions,
+                        Atom *unfounded, Model *model) {
+    while (solve(solver, assumptions, n_assumptions)) {
+        model_clear(model);
+        for (Atom a = 0; a < solver->n_atoms; a++) {
+            if (solver->values[a] == VALUE_TRUE) model_add(model, a);
+        }
+        int n_unfounded = find_unfounded_atoms(solver, kb->facts, kb->n_facts, unfounded);
+        backtrack(solver, 0);
+        if (n_unfounded == 0) return true;
+        add_loop_formulas(solver, unfounded, n_unfounded);
+    }
+    backtrack(solver, 0);
+    return false;
+}
+
+/* Function for turning the decisions flipped by an enumeration into
+ * clauses, before it restarts from level 0: each flipped literal holds
+ * whenever the decisions, assumptions and flips assigned before it hold,
+ * the models on its other side having all been found. The solver is left
+ * at level 0 with these clauses and a backtrack level of 0. */
+void keep_flipped_decisions(Solver *solver) {
+    Literal *chosen = safe_malloc((solver->n_vars + 1) * sizeof(Literal));
+    bool *flipped = safe_malloc((solver->n_vars + 1) * sizeof(bool));
+    int n_chosen = 0;
+    for (int i = 0; i < solver->n_trail; i++) {
+        int var = solver->trail[i] >> 1;
+        if (solver->levels[var] == 0 || solver->reasons[var] != -1) continue;
+        flipped[n_chosen] = i != solver->trail_limits[solver->levels[var] - 1];
+        chosen[n_chosen++] = solver->trail[i];
+    }
+    backtrack(solver, 0);
+    solver->backtrack_level = 0;
+    Literal *clause = safe_malloc((n_chosen + 1) * sizeof(Literal));
+    for (int i = 0; i < n_chosen; i++) {
+        if (!flipped[i]) continue;
+        for (int j = 0; j < i; j++) clause[j] = chosen[j] ^ 1;
+        clause[i] = chosen[i];
+        add_clause(solver, clause, i + 1);
+    }
+    free(clause);
+    free(flipped);
+    free(chosen);
+}
+
+/* Function for enumerating the models of the stage of a solver in which
+ * the assumed literals hold: every founded model it finds is kept, handed
+ * to visit, if any, and passed by flipping the last decision, the search
+ * going on from there (flip_decision) rather than from level 0, so that
+ * each model costs about one propagation and no clause. An unfounded model
+ * adds its loop formulas at level 0, the flips made so far being kept as
+ * clauses. Models are listed in the order they are found, and there are no
+ * duplicates. The solver is left at level 0. */
+ModelSet solve_region(Solver *solver, const KnowledgeBase *kb, const Literal *assumptions, int n_assumptions,
+                      NewModelVisitor visit, void *context) {
+    int n_atoms = solver->n_atoms;
+    ModelSet set;
+    init_model_set(&set, model_words_for(n_atoms));
+    Model model = new_model(set.n_words);
+    Atom *unfounded = safe_malloc((n_atoms > 0 ? n_atoms : 1) * sizeof(Atom));
+    while (solve(solver, assumptions, n_assumptions)) {
+        model_clear(&model);
+        for (Atom a = 0; a < n_atoms; a++) {
+            if (solver->values[a] == VALUE_TRUE) model_add(&model, a);
+        }
+        int n_unfounded = find_unfounded_atoms(solver, kb->facts, kb->n_facts, unfounded);
+        if (n_unfounded > 0) {
+            keep_flipped_decisions(solver);
+            add_loop_formulas(solver, unfounded, n_unfounded);
+            continue;
+        }
+        model_set_insert(&set, &model, set.n_models);
+        if (visit) visit(&model, context);
+        if (!flip_decision(solver, n_assumptions)) break;
+    }
+    backtrack(solver, 0);
+    solver->backtrack_level = 0;
+    free(unfounded);
+    free_model(&model);
+    return set;
+}
+
+/* Function for enumerating the models of a stage (cnsᵈ or out₁) of a
+ * knowledge base with the solver, handing each one to visit, if any. */
+ModelSet solve_stage(const KnowledgeBase *kb, Stage stage, NewModelVisitor visit, void *context) {
+    Solver solver = new_solver(kb, stage);
+    ModelSet set = solve_region(&solver, kb, NULL, 0, visit, context);
+    free_solver(&solver);
+    return set;
+}
+
+/* Function for computing the requested stages (cnsᵈ(R,A), out₁(R,A)) with
+ * the solver, one run per stage, streaming the models of stream_stage, if
+ * any, to stream_visit as compute_results does. def(R) is neither
+ * enumerated nor counted, and n_def_programs is left at 0. */
+Results solve_results(const KnowledgeBase *kb, int stages, Stage stream_stage, NewModelVisitor stream_visit, void *stream_context) {
+    Results results;
+    results.n_def_programs = 0;
+    results.n_def_programs_overflows = false;
+    results.coverage = 1;
+    results.streamed = stages & stream_stage ? stream_stage : 0;
+    int n_words = model_words_for(kb->symbols.n_symbols);
+    if (stages & STAGE_CNSD) {
+        results.cnsd = solve_stage(kb, STAGE_CNSD, results.streamed == STAGE_CNSD ? stream_visit : NULL, stream_context);
+    } else {
+        init_model_set(&results.cnsd, n_words);
+    }
+    if (stages & STAGE_OUT1) {
+        results.out1 = solve_stage(kb, STAGE_OUT1, results.streamed == STAGE_OUT1 ? stream_visit : NULL, stream_context);
+    } else {
+        init_model_set(&results.out1, n_words);
+    }
+    init_model_runs(&results.cnsd_runs, n_words);
+    init_model_runs(&results.out1_runs, n_words);
+    return results;
+}
+
+/* Function for checking that the solver found the same models as the
+ * enumeration of def(R) for the requested stages. Reports the first
+ * difference on stderr and exits if they differ. */
+void check_solver_results(const Results *enumerated, const Results *solved, int stages) {
+    for (int stage = STAGE_CNSD; stage <= STAGE_OUT1; stage <<= 1) {
+        if (!(stages & stage)) continue;
+        const ModelSet *expected = stage == STAGE_CNSD ? &enumerated->cnsd : &enumerated->out1;
+        const ModelSet *found = stage == STAGE_CNSD ? &solved->cnsd : &solved->out1;
+        bool same = expected->n_models == found->n_models;
+        for (size_t j = 0; same && j < found->n_models; j++) {
+            Model m = model_set_at(found, j);
+            same = model_set_contains(expected, &m);
+        }
+        if (!same) {
+            fprintf(stderr, "The solver and the enumeration of def(R) disagree on %s (%zu and %zu models).\n",
+                    stage == STAGE_CNSD ? "cnsᵈ(R,A)" : "out₁(R,A)", found->n_models, expected->n_models);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+/* Function for shrinking a model of the stage of a solver to a ⊆-minimal
+ * one: for every atom a of the model in turn, but the facts, look for a
+ * model without a and without the atoms the model lacks, and go on from
+ * it if there is one. An atom that cannot be dropped from a model cannot
+ * be dropped from its submodels either, so a single pass suffices.
+ * assumptions holds n_atoms literals, smaller is a scratch model. */
+void minimize_model(Solver *solver, const KnowledgeBase *kb, Model *model, Literal *assumptions, Atom *unfounded,
+                    Model *smaller) {
+    for (Atom a = 0; a < solver->n_atoms; a++) {
+        if (!model_contains(model, a) || solver->values[a] == VALUE_TRUE) continue;
+        int n_assumptions = 0;
+        assumptions[n_assumptions++] = 2 * a + 1;
+        for (Atom b = 0; b < solver->n_atoms; b++) {
+            if (!model_contains(model, b)) assumptions[n_assumptions++] = 2 * b + 1;
+        }
+        if (find_founded_model(solver, kb, assumptions, n_assumptions, unfounded, smaller)) {
+            memcpy(model->words, smaller->words, model->n_words * sizeof(ModelWord));
+        }
+    }
+}
+
+/* Function for enumerating the ⊆-minimal models of the stage of a solver:
+ * every model found is shrunk to a minimal one, kept, handed to visit, if
+ * any, and then subsumes all its supersets, which a clause requiring one
+ * of its atoms to be false excludes from the rest of the search. Minimal
+ * models are listed in the order they are found. The solver is left with
+ * these clauses, and finds no other model afterwards. */
+ModelSet find_minimal_models(Solver *solver, const KnowledgeBase *kb, NewModelVisitor visit, void *context) {
+    int n_atoms = solver->n_atoms;
+    ModelSet set;
+    init_model_set(&set, model_words_for(n_atoms));
+    Model model = new_model(set.n_words), smaller = new_model(set.n_words);
+    Atom *unfounded = safe_malloc((n_atoms > 0 ? n_atoms : 1) * sizeof(Atom));
+    Literal *literals = safe_malloc((n_atoms > 0 ? n_atoms : 1) * sizeof(Literal));
+    while (find_founded_model(solver, kb, NULL, 0, unfounded, &model)) {
+        minimize_model(solver, kb, &model, literals, unfounded, &smaller);
+        model_set_insert(&set, &model, set.n_models);
+        if (visit) visit(&model, context);
+        int n_literals = 0;
+        for (Atom a = 0; a < n_atoms; a++) {
+            if (model_contains(&model, a) && solver->values[a] == VALUE_UNASSIGNED) literals[n_literals++] = 2 * a + 1;
+        }
+        add_clause(solver, literals, n_literals);
+    }
+    free(literals);
+    free(unfounded);
+    free_model(&smaller);
+    free_model(&model);
+    return set;
+}
+
+/* Function for adding a selector to the solver of a maintained out₁(R,A):
+ * a new variable, live until retired. Returns its positive literal. */
+Literal add_selector(MaintainedOut1 *maintained) {
+    if (maintained->n_selectors == maintained->selector_capacity) {
+        maintained->selector_capacity = maintained->selector_capacity > 0 ? 2 * maintained->selector_capacity : 16;
+        maintained->selectors = safe_realloc(maintained->selectors, maintained->selector_capacity * sizeof(Literal));
+    }
+    Literal selector = 2 * add_solver_variable(&maintained->solver);
+    maintained->selectors[maintained->n_selectors++] = selector;
+    return selector;
+}
+
+/* Function for retiring a live selector of a maintained out₁(R,A): it is
+ * made false at level 0, which satisfies the clauses it guards. */
+void retire_selector(MaintainedOut1 *maintained, Literal selector) {
+    int i = 0;
+    while (maintained->selectors[i] != selector) i++;
+    maintained->selectors[i] = maintained->selectors[--maintained->n_selectors];
+    Literal retired = selector ^ 1;
+    add_clause(&maintained->solver, &retired, 1);
+}
+
+/* Function for retiring a selector, if not -1, and adding a new one in its
+ * place. Returns the new one. */
+Literal renew_selector(MaintainedOut1 *maintained, Literal selector) {
+    if (selector >= 0) retire_selector(maintained, selector);
+    return add_selector(maintained);
+}
+
+/* Function for guarding the support clause of an atom anew after its
+ * facts or the rules deriving it changed: the old clause is retired, and
+ * unless the atom is a fact, a clause over the current rules is added. */
+void guard_support(MaintainedOut1 *maintained, Atom a) {
+    if (maintained->support_selectors[a] >= 0) retire_selector(maintained, maintained->support_selectors[a]);
+    maintained->support_selectors[a] = -1;
+    if (maintained->fact_selectors[a] >= 0) return;
+    maintained->support_selectors[a] = add_selector(maintained);
+    add_support_clause(&maintained->solver, a, maintained->support_selectors[a]);
+}
+
+/* Function for dropping the clauses of retired selectors from the solver
+ * of a maintained out₁(R,A), once the clauses grew to twice their size
+ * after the last time. */
+void drop_retired_clauses(MaintainedOut1 *maintained) {
+    if (maintained->solver.n_clause_ints <= 2 * maintained->n_clause_ints_kept) return;
+    remove_satisfied_clauses(&maintained->solver);
+    maintained->n_clause_ints_kept = maintained->solver.n_clause_ints;
+}
+
+/* Function for enumerating the models of out₁(R,A) in a region, those in
+ * which its literals hold, with the solver of a maintained out₁(R,A), its
+ * live selectors being assumed first. */
+ModelSet search_maintained(MaintainedOut1 *maintained, const Literal *region, int n_region) {
+    int n_assumptions = maintained->n_selectors + n_region;
+    Literal *assumptions = safe_malloc((n_assumptions > 0 ? n_assumptions : 1) * sizeof(Literal));
+    memcpy(assumptions, maintained->selectors, maintained->n_selectors * sizeof(Literal));
+    if (n_region > 0) memcpy(assumptions + maintained->n_selectors, region, n_region * sizeof(Literal));
+    ModelSet found = solve_region(&maintained->solver, maintained->kb, assumptions, n_assumptions, NULL, NULL);
+    free(assumptions);
+    return found;
+}
+
+/* Function for computing out₁(R,A) of a knowledge base, to be maintained
+ * under its updates, building a solver whose facts, rules and support
+ * clauses are guarded by selectors. The knowledge base stays owned by the
+ * caller. */
+void init_maintained_out1(MaintainedOut1 *maintained, KnowledgeBase *kb) {
+    int n_atoms = kb->symbols.n_symbols, n_rules = kb->n_rules;
+    maintained->kb = kb;
+    maintained->solver = empty_solver(n_atoms, 2 * n_atoms + 2 * n_rules + 2);
+    Solver *solver = &maintained->solver;
+    solver->rules = kb->rules;
+    solver->n_rules = n_rules;
+    solver->body_literals = safe_malloc((n_rules > 0 ? n_rules : 1) * sizeof(Literal));
+    for (int i = 0; i < n_rules; i++) {
+        solver->body_literals[i] = new_body_literal(solver, &kb->rules[i]);
+    }
+    index_solver_rules(solver);
+    maintained->selectors = NULL;
+    maintained->n_selectors = 0;
+    maintained->selector_capacity = 0;
+    maintained->fact_selectors = safe_malloc((n_atoms > 0 ? n_atoms : 1) * sizeof(Literal));
+    maintained->support_selectors = safe_malloc((n_atoms > 0 ? n_atoms : 1) * sizeof(Literal));
+    maintained->rule_selectors = safe_malloc((n_rules > 0 ? n_rules : 1) * sizeof(Literal));
+    for (Atom a = 0; a < n_atoms; a++) {
+        maintained->fact_selectors[a] = -1;
+        maintained->support_selectors[a] = -1;
+    }
+    for (int f = 0; f < kb->n_facts; f++) {
+        Atom a = kb->facts[f];
+        if (maintained->fact_selectors[a] >= 0) continue;
+        maintained->fact_selectors[a] = add_selector(maintained);
+        Literal clause[2] = { 2 * a, maintained->fact_selectors[a] ^ 1 };
+        add_clause(solver, clause, 2);
+    }
+    for (int i = 0; i < n_rules; i++) {
+        maintained->rule_selectors[i] = add_selector(maintained);
+        add_rule_clauses(solver, i, STAGE_OUT1, maintained->rule_selectors[i]);
+    }
+    for (Atom a = 0; a < n_atoms; a++) {
+        guard_support(maintained, a);
+    }
+    solver->loop_guard = add_selector(maintained);
+    maintained->search_selector = add_selector(maintained);
+    maintained->out1 = search_maintained(maintained, NULL, 0);
+    maintained->n_clause_ints_kept = solver->n_clause_ints;
+    init_model_set(&maintained->added, maintained->out1.n_words);
+    init_model_set(&maintained->removed, maintained->out1.n_words);
+}
+
+/* Free the solver and the models of a maintained out₁(R,A), and of its
+ * last update. */
+void free_maintained_out1(MaintainedOut1 *maintained) {
+    free_solver(&maintained->solver);
+    free(maintained->fact_selectors);
+    free(maintained->support_selectors);
+    free(maintained->rule_selectors);
+    free(maintained->selectors);
+    free_model_set(&maintained->out1);
+    free_model_set(&maintained->added);
+    free_model_set(&maintained->removed);
+}
+
+/* Function for emptying the models added and removed by the last update. */
+void clear_delta(MaintainedOut1 *maintained) {
+    free_model_set(&maintained->added);
+    free_model_set(&maintained->removed);
+    init_model_set(&maintained->added, maintained->out1.n_words);
+    init_model_set(&maintained->removed, maintained->out1.n_words);
+}
+
+/* Function for renumbering the atoms of the maintained models and of their
+ * solver once new atoms were interned in the knowledge base, and its
+ * symbols and rules renumbered: atom a becomes renumber[a], selectors move
+ * up with the other variables of the solver, and the new atoms, which are
+ * no fact and head no rule yet, get their support clauses. The last delta
+ * is cleared. */
+void renumber_maintained_models(MaintainedOut1 *maintained, const Atom *renumber) {
+    int n_old_atoms = maintained->solver.n_atoms, n_atoms = maintained->kb->symbols.n_symbols;
+    int shift = 2 * (n_atoms - n_old_atoms);
+    renumber_solver_atoms(&maintained->solver, renumber, n_atoms);
+    for (int i = 0; i < maintained->n_selectors; i++) {
+        maintained->selectors[i] += shift;
+    }
+    for (int i = 0; i < maintained->kb->n_rules; i++) {
+        maintained->rule_selectors[i] += shift;
+    }
+    maintained->search_selector += shift;
+    Literal *fact_selectors = safe_malloc(n_atoms * sizeof(Literal));
+    Literal *support_selectors = safe_malloc(n_atoms * sizeof(Literal));
+    for (Atom a = 0; a < n_atoms; a++) {
+        fact_selectors[a] = -1;
+        support_selectors[a] = -1;
+    }
+    for (Atom a = 0; a < n_old_atoms; a++) {
+        if (maintained->fact_selectors[a] >= 0) fact_selectors[renumber[a]] = maintained->fact_selectors[a] + shift;
+        if (maintained->support_selectors[a] >= 0) support_selectors[renumber[a]] = maintained->support_selectors[a] + shift;
+    }
+    free(maintained->fact_selectors);
+    free(maintained->support_selectors);
+    maintained->fact_selectors = fact_selectors;
+    maintained->support_selectors = support_selectors;
+    for (Atom a = 0; a < n_atoms; a++) {
+        if (fact_selectors[a] < 0 && support_selectors[a] < 0) guard_support(maintained, a);
+    }
+    
+    ModelSet out1;
+    init_model_set(&out1, model_words_for(n_atoms));
+    Model renumbered = new_model(out1.n_words);
+    Atom *atoms = safe_malloc(maintained->out1.n_words * MODEL_WORD_BITS * sizeof(Atom));
+    for (size_t j = 0; j < maintained->out1.n_models; j++) {
+        Model m = model_set_at(&maintained->out1, j);
+        int n_model_atoms = model_atoms(&m, atoms);
+        model_clear(&renumbered);
+        for (int k = 0; k < n_model_atoms; k++) {
+            model_add(&renumbered, renumber[atoms[k]]);
+        }
+        model_set_insert(&out1, &renumbered, j);
+    }
+    free(atoms);
+    free_model(&renumbered);
+    free_model_set(&maintained->out1);
+    maintained->out1 = out1;
+    clear_delta(maintained);
+}
+
+/* Function for checking whether all the literals of a region hold in a model. */
+bool region_holds(const Model *m, const Literal *region, int n_region) {
+    for (int i = 0; i < n_region; i++) {
+        if (model_contains(m, region[i] >> 1) == (region[i] & 1)) return false;
+    }
+    return true;
+}
+
+/* Function for searching the models of out₁(R,A) in a region, those in
+ * which its literals hold, again with the solver of the updated knowledge
+ * base: the old models of the region not found are removed, and the
+ * models found that are not old are added. */
+void recompute_region(MaintainedOut1 *maintained, const Literal *region, int n_region) {
+    ModelSet found = search_maintained(maintained, region, n_region);
+    for (size_t j = 0; j < maintained->out1.n_models; j++) {
+        Model m = model_set_at(&maintained->out1, j);
+        if (region_holds(&m, region, n_region) && !model_set_contains(&found, &m)) {
+            model_set_insert(&maintained->removed, &m, 0);
+        }
+    }
+    for (size_t j = 0; j < found.n_models; j++) {
+        Model m = model_set_at(&found, j);
+        if (!model_set_contains(&maintained->out1, &m)) model_set_insert(&maintained->added, &m, 0);
+    }
+    free_model_set(&found);
+}
+
+/* Function for applying the last delta to out₁(R,A). The models left keep
+ * their order, and the models added come last. */
+void apply_delta(MaintainedOut1 *maintained) {
+    if (maintained->removed.n_models > 0) {
+        ModelSet out1;
+        init_model_set(&out1, maintained->out1.n_words);
+        for (size_t j = 0; j < maintained->out1.n_models; j++) {
+            Model m = model_set_at(&maintained->out1, j);
+            if (!model_set_contains(&maintained->removed, &m)) model_set_insert(&out1, &m, out1.n_models);
+        }
+        free_model_set(&maintained->out1);
+        maintained->out1 = out1;
+    }
+    for (size_t j = 0; j < maintained->added.n_models; j++) {
+        Model m = model_set_at(&maintained->added, j);
+        model_set_insert(&maintained->out1, &m, maintained->out1.n_models);
+    }
+}
+
+/* Function for finding the atoms that adding the fact a can affect: a, and
+ * the head atoms of the rules whose body has an affected atom or whose head
+ * has one, added to affected. The atoms of the bodies of the rules and
+ * constraints having an affected atom that are not affected themselves,
+ * through which the other atoms bear on the affected ones, are added to
+ * boundary. */
+void find_affected_atoms(const Solver *solver, Atom a, Model *affected, Model *boundary) {
+    Atom *queue = safe_malloc(solver->n_atoms * sizeof(Atom));
+    int n_queued = 0;
+    model_add(affected, a);
+    queue[n_queued++] = a;
+    for (int pass = 0; pass < 2; pass++) {
+        for (int next = 0; next < n_queued; next++) {
+            Atom x = queue[next];
+            for (int by_head = 0; by_head < 2; by_head++) {
+                const int *start = by_head ? solver->head_start : solver->watch_start;
+                const int *rules = by_head ? solver->head_rules : solver->watch_rules;
+                for (int j = start[x]; j < start[x + 1]; j++) {
+                    const Rule *r = &solver->rules[rules[j]];
+                    for (int k = 0; pass == 0 && k < r->n_atoms_in_head; k++) {
+                        Atom h = r->head[k];
+                        if (h != BOTTOM && !model_contains(affected, h)) {
+                            model_add(affected, h);
+                            queue[n_queued++] = h;
+                        }
+                    }
+                    for (int k = 0; pass == 1 && k < r->n_atoms_in_body; k++) {
+                        if (!model_contains(affected, r->body[k])) model_add(boundary, r->body[k]);
+                    }
+                }
+            }
+        }
+    }
+    free(queue);
+}
+
+/* Function for finding the delta of out₁(R,A) once the fact a was added.
+ * A fact only grows least models, so a new model is an old one grown, and
+ * only its affected atoms may change (find_affected_atoms), each with a
+ * rule whose body or head has an affected atom, so its other atoms, its
+ * outside, are those of an old model. The affected atoms only depend on
+ * the outside through the boundary. Hence the distinct outsides of the old
+ * models are grouped by their boundary atoms, the affected atoms of each
+ * group are searched once with the outside fixed as in one of its
+ * members, and each outside of the group is completed with each of them. */
+void insert_fact_models(MaintainedOut1 *maintained, Atom a) {
+    int n_atoms = maintained->solver.n_atoms, n_words = maintained->out1.n_words;
+    Model affected = new_model(n_words), boundary = new_model(n_words);
+    find_affected_atoms(&maintained->solver, a, &affected, &boundary);
+    ModelSet outsides;
+    init_model_set(&outsides, n_words);
+    Model part = new_model(n_words);
+    for (size_t j = 0; j < maintained->out1.n_models; j++) {
+        Model m = model_set_at(&maintained->out1, j);
+        for (int w = 0; w < n_words; w++) {
+            part.words[w] = m.words[w] & ~affected.words[w];
+        }
+        model_set_insert(&outsides, &part, j);
+    }
+    ModelSet keys, out1;
+    init_model_set(&keys, n_words);
+    init_model_set(&out1, n_words);
+    ModelSet *insides = NULL;
+    Literal *region = safe_malloc((n_atoms > 0 ? n_atoms : 1) * sizeof(Literal));
+    for (size_t j = 0; j < outsides.n_models; j++) {
+        Model outside = model_set_at(&outsides, j);
+        for (int w = 0; w < n_words; w++) {
+            part.words[w] = outside.words[w] & boundary.words[w];
+        }
+        ptrdiff_t group = model_set_find(&keys, &part);
+        if (group < 0) {
+            group = (ptrdiff_t)keys.n_models;
+            model_set_insert(&keys, &part, j);
+            insides = safe_realloc(insides, keys.n_models * sizeof(ModelSet));
+            int n_region = 0;
+            for (Atom b = 0; b < n_atoms; b++) {
+                if (!model_contains(&affected, b)) region[n_region++] = 2 * b + !model_contains(&outside, b);
+            }
+            ModelSet found = search_maintained(maintained, region, n_region);
+            init_model_set(&insides[group], n_words);
+            for (size_t k = 0; k < found.n_models; k++) {
+                Model m = model_set_at(&found, k);
+                for (int w = 0; w < n_words; w++) {
+                    part.words[w] = m.words[w] & affected.words[w];
+                }
+                model_set_insert(&insides[group], &part, k);
+            }
+            free_model_set(&found);
+        }
+        for (size_t k = 0; k < insides[group].n_models; k++) {
+            Model inside = model_set_at(&insides[group], k);
+            for (int w = 0; w < n_words; w++) {
+                part.words[w] = outside.words[w] | inside.words[w];
+            }
+            model_set_insert(&out1, &part, out1.n_models);
+        }
+    }
+    for (size_t j = 0; j < maintained->out1.n_models; j++) {
+        Model m = model_set_at(&maintained->out1, j);
+        if (!model_set_contains(&out1, &m)) model_set_insert(&maintained->removed, &m, 0);
+    }
+    for (size_t j = 0; j < out1.n_models; j++) {
+        Model m = model_set_at(&out1, j);
+        if (!model_set_contains(&maintained->out1, &m)) model_set_insert(&maintained->added, &m, 0);
+    }
+    for (size_t g = 0; g < keys.n_models; g++) {
+        free_model_set(&insides[g]);
+    }
+    free(insides);
+    free(region);
+    free_model_set(&out1);
+    free_model_set(&keys);
+    free_model(&part);
+    free_model_set(&outsides);
+    free_model(&boundary);
+    free_model(&affected);
+}
+
+/* Function for finding the delta of out₁(R,A) once the fact a was
+ * retracted: the old models containing a stay if they are still founded
+ * without it, and the new models all lack a. */
+void retract_fact_models(MaintainedOut1 *maintained, Atom a) {
+    Solver *solver = &maintained->solver;
+    int n_atoms = solver->n_atoms, n_selectors = maintained->n_selectors;
+    Literal region = 2 * a + 1;
+    recompute_region(maintained, &region, 1);
+    Literal *assumptions = safe_malloc((n_selectors + n_atoms + 1) * sizeof(Literal));
+    Atom *unfounded = safe_malloc((n_atoms > 0 ? n_atoms : 1) * sizeof(Atom));
+    Model founded = new_model(maintained->out1.n_words);
+    memcpy(assumptions, maintained->selectors, n_selectors * sizeof(Literal));
+    for (size_t j = 0; j < maintained->out1.n_models; j++) {
+        Model m = model_set_at(&maintained->out1, j);
+        if (!model_contains(&m, a)) continue;
+        for (Atom b = 0; b < n_atoms; b++) {
+            assumptions[n_selectors + b] = 2 * b + !model_contains(&m, b);
+        }
+        if (!find_founded_model(solver, maintained->kb, assumptions, n_selectors + n_atoms, unfounded, &founded)) {
+            model_set_insert(&maintained->removed, &m, 0);
+        }
+    }
+    free_model(&founded);
+    free(unfounded);
+    free(assumptions);
+}
+
+/* Function for updating out₁(R,A) as the fact a is added to A (insert) or
+ * retracted from it, leaving the delta in added and removed. The fact is
+ * guarded by a selector of its own, and the support clause of a by
+ * another while a is not a fact. An added fact may make the loop formulas
+ * found so far wrong, so they are retired. Returns false if a is
+ * retracted without being a fact. */
+bool update_fact(MaintainedOut1 *maintained, Atom a, bool insert) {
+    KnowledgeBase *kb = maintained->kb;
+    Solver *solver = &maintained->solver;
+    clear_delta(maintained);
+    bool is_fact = false;
+    int n_facts = 0;
+    for (int f = 0; f < kb->n_facts; f++) {
+        if (kb->facts[f] == a) is_fact = true;
+        else kb->facts[n_facts++] = kb->facts[f];
+    }
+    if (insert) {
+        kb->facts = safe_realloc(kb->facts, (n_facts + 1) * sizeof(Atom));
+        kb->facts[n_facts++] = a;
+    }
+    kb->n_facts = n_facts;
+    if (insert == is_fact) return insert;
+    if (insert) {
+        maintained->fact_selectors[a] = add_selector(maintained);
+        Literal clause[2] = { 2 * a, maintained->fact_selectors[a] ^ 1 };
+        add_clause(solver, clause, 2);
+        solver->loop_guard = renew_selector(maintained, solver->loop_guard);
+    } else {
+        retire_selector(maintained, maintained->fact_selectors[a]);
+        maintained->fact_selectors[a] = -1;
+    }
+    guard_support(maintained, a);
+    maintained->search_selector = renew_selector(maintained, maintained->search_selector);
+    drop_retired_clauses(maintained);
+    if (insert) insert_fact_models(maintained, a);
+    else retract_fact_models(maintained, a);
+    apply_delta(maintained);
+    return true;
+}
+
+/* Function for checking whether two lists of atoms hold the same atoms. */
+bool same_atom_sets(const Atom *a, int n_a, const Atom *b, int n_b) {
+    for (int i = 0; i < n_a; i++) {
+        int k = 0;
+        while (k < n_b && b[k] != a[i]) k++;
+        if (k == n_b) return false;
+    }
+    for (int i = 0; i < n_b; i++) {
+        int k = 0;
+        while (k < n_a && a[k] != b[i]) k++;
+        if (k == n_a) return false;
+    }
+    return true;
+}
+
+/* Function for updating out₁(R,A) as a rule is added to R (insert), which
+ * then owns it, or retracted from it, leaving the delta in added and
+ * removed. A retracted rule is the first one of R of the same type with
+ * the same sets of body and head atoms. The rule is guarded by a selector
+ * of its own, and the support clauses of its head atoms are guarded anew;
+ * an added rule retires the loop formulas found so far. Where the body of
+ * the rule is not in a model, the rule neither applies nor derives
+ * anything, so only the models containing the body are searched again.
+ * Returns false if no rule of R matches a retracted rule. */
+bool update_rule(MaintainedOut1 *maintained, const Rule *rule, bool insert) {
+    KnowledgeBase *kb = maintained->kb;
+    Solver *solver = &maintained->solver;
+    clear_delta(maintained);
+    if (insert) {
+        int i = kb->n_rules++;
+        kb->rules = safe_realloc(kb->rules, kb->n_rules * sizeof(Rule));
+        kb->rules[i] = *rule;
+        solver->body_literals = safe_realloc(solver->body_literals, kb->n_rules * sizeof(Literal));
+        solver->body_literals[i] = new_body_literal(solver, rule);
+        maintained->rule_selectors = safe_realloc(maintained->rule_selectors, kb->n_rules * sizeof(Literal));
+        maintained->rule_selectors[i] = add_selector(maintained);
+        solver->rules = kb->rules;
+        solver->n_rules = kb->n_rules;
+        index_solver_rules(solver);
+        add_rule_clauses(solver, i, STAGE_OUT1, maintained->rule_selectors[i]);
+        solver->loop_guard = renew_selector(maintained, solver->loop_guard);
+    } else {
+        int i = 0;
+        while (i < kb->n_rules &&
+               !(kb->rules[i].ruletype == rule->ruletype &&
+                 same_atom_sets(kb->rules[i].body, kb->rules[i].n_atoms_in_body, rule->body, rule->n_atoms_in_body) &&
+                 same_atom_sets(kb->rules[i].head, kb->rules[i].n_atoms_in_head, rule->head, rule->n_atoms_in_head))) {
+            i++;
+        }
+        if (i == kb->n_rules) return false;
+        retire_selector(maintained, maintained->rule_selectors[i]);
+        free(kb->rules[i].body);
+        free(kb->rules[i].head);
+        int n_after = kb->n_rules - i - 1;
+        memmove(&kb->rules[i], &kb->rules[i + 1], n_after * sizeof(Rule));
+        memmove(&solver->body_literals[i], &solver->body_literals[i + 1], n_after * sizeof(Literal));
+        memmove(&maintained->rule_selectors[i], &maintained->rule_selectors[i + 1], n_after * sizeof(Literal));
+        kb->n_rules--;
+        solver->n_rules = kb->n_rules;
+        index_solver_rules(solver);
+    }
+    for (int k = 0; k < rule->n_atoms_in_head; k++) {
+        if (rule->head[k] != BOTTOM) guard_support(maintained, rule->head[k]);
+    }
+    maintained->search_selector = renew_selector(maintained, maintained->search_selector);
+    drop_retired_clauses(maintained);
+    
+    /* The region is the body of the rule, its atoms being distinct literals. */
+    Model body = new_model(maintained->out1.n_words);
+    model_set_atoms(&body, rule->body, rule->n_atoms_in_body);
+    Atom *atoms = safe_malloc(body.n_words * MODEL_WORD_BITS * sizeof(Atom));
+    int n_region = model_atoms(&body, atoms);
+    Literal *region = safe_malloc((n_region > 0 ? n_region : 1) * sizeof(Literal));
+    for (int k = 0; k < n_region; k++) {
+        region[k] = 2 * atoms[k];
+    }
+    recompute_region(maintained, region, n_region);
+    apply_delta(maintained);
+    free(region);
+    free(atoms);
+    free_model(&body);
+    return true;
+}
+
+/* Function for computing cnsᵈ(R,A) or out₁(R,A), as selected by stage, by
+ * restarting an existing search from the facts A, sequentially. Reusing the
+ * search saves allocating its buffers for every fact set. */
+ModelSet rerun_def_search(DefSearch *search, Atom *facts, int n_facts, Stage stage) {
+    ResultsCollector collector;
+    collector.stages = stage;
+    collector.max_models = 0;
+    collector.max_models_in_memory = 0;
+    collector.def_visit = NULL;
+    collector.def_context = NULL;
+    collector.program.clause_ids = NULL;
+    init_model_set(stage == STAGE_CNSD ? &collector.cnsd : &collector.out1, search->compiled->n_words);
+    search->prune_violations = stage == STAGE_OUT1;
+    reset_def_search(search, facts, n_facts);
+    run_def_search(search, NULL, collect_results, &collector);
+    return stage == STAGE_CNSD ? collector.cnsd : collector.out1;
+}
+
+/* Thread body evaluating the queries of a batch: every thread keeps a
+ * single search over the compiled rules, restarted from the facts of each
+ * query it takes, so that no per-query work depends on |R| beyond resetting
+ * the counters. */
+void *run_query_worker(void *arg) {
+    QueryBatch *batch = arg;
+    DefSearch search;
+    init_def_search(&search, batch->compiled, NULL, 0, true);
+    while (true) {
+        int q = __atomic_fetch_add(&batch->next_query, 1, __ATOMIC_RELAXED);
+        if (q >= batch->n_queries) break;
+        Query *query = &batch->queries[q];
+        query->out1 = rerun_def_search(&search, query->facts, query->n_facts, STAGE_OUT1);
+    }
+    free_def_search(&search);
+    STATS_FLUSH();
+    return NULL;
+}
+
+/* Function for computing out₁(R,A) for every query A of a batch, against
+ * rules compiled once, on n_threads threads. Queries are independent, so
+ * each one is evaluated by a single thread, with subtrees violating a
+ * constraint pruned. */
+void evaluate_queries(const CompiledRules *compiled, Query *queries, int n_queries, int n_threads) {
+    QueryBatch batch = { compiled, queries, n_queries, 0 };
+    if (n_threads > n_queries) n_threads = n_queries;
+    if (n_threads <= 1) {
+        run_query_worker(&batch);
+        return;
+    }
+    pthread_t *threads = safe_malloc(n_threads * sizeof(pthread_t));
+    for (int i = 0; i < n_threads; i++) {
+        if (pthread_create(&threads[i], NULL, run_query_worker, &batch) != 0) {
+            perror("Thread creation failed!");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (int i = 0; i < n_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+}
+
+/* Free the facts and extra atoms of a query. */
+void free_query_atoms(Query *query) {
+    for (int i = 0; i < query->n_extras; i++) {
+        free(query->extras[i]);
+    }
+    free(query->extras);
+    free(query->facts);
+}
+
+/* Free the facts, extra atoms and results of a query. */
+void free_query(Query *query) {
+    free_query_atoms(query);
+    free_model_set(&query->out1);
+}
+
+/* * * * * * * * * * * * * * * * * * * * I/O * * * * * * * * * * * * * * * * * * * * * */
+
+/* Function for initializing a buffered writer to a stream. */
+void init_writer(Writer *writer, FILE *stream) {
+    writer->stream = stream;
+    writer->buffer = safe_malloc(WRITER_BUFFER_SIZE);
+    writer->length = 0;
+}
+
+/* Function for passing the buffered bytes of a writer on to its stream. */
+void writer_flush(Writer *writer) {
+    if (writer->length > 0 && fwrite(writer->buffer, 1, writer->length, writer->stream) != writer->length) {
+        perror("Write failed!");
+        exit(EXIT_FAILURE);
+    }
+    writer->length = 0;
+}
+
+/* Function for writing bytes through a writer. */
+void writer_write(Writer *writer, const void *data, size_t size) {
+    if (size > WRITER_BUFFER_SIZE - writer->length) {
+        writer_flush(writer);
+        if (size > WRITER_BUFFER_SIZE) {
+            if (fwrite(data, 1, size, writer->stream) != size) {
+                perror("Write failed!");
+                exit(EXIT_FAILURE);
+            }
+            return;
+        }
+    }
+    memcpy(writer->buffer + writer->length, data, size);
+    writer->length += size;
+}
+
+/* Function for writing a string through a writer. */
+void writer_puts(Writer *writer, const char *string) {
+    writer_write(writer, string, strlen(string));
+}
+
+/* Function for writing an integer through a writer, as little-endian bytes. */
+void writer_put_uint(Writer *writer, uint64_t value, int n_bytes) {
+    unsigned char bytes[8];
+    for (int i = 0; i < n_bytes; i++) {
+        bytes[i] = (unsigned char)(value >> (8 * i));
+    }
+    writer_write(writer, bytes, n_bytes);
+}
+
+/* Flush a writer and free its buffer. */
+void free_writer(Writer *writer) {
+    writer_flush(writer);
+    free(writer->buffer);
+}
+
+/* Function for printing a set of atoms. */
+void print_atoms(const SymbolTable *symbols, Atom facts[], int n_atoms_in_facts) {
+    printf("A: \n");
+    for (int i = 0; i < n_atoms_in_facts; i++) {
+        printf("%s", atom_name(symbols, facts[i]));
+        if (i < n_atoms_in_facts - 1) printf(", ");
+    }
+    printf("\n\n");
+}
+
+/* Function for printing a single rule. */
+void print_rule(const SymbolTable *symbols, Rule r) {
+    for (int i = 0; i < r.n_atoms_in_body; i++) {
+        printf("%s", atom_name(symbols, r.body[i]));
+        if (i < r.n_atoms_in_body - 1) printf(" ∧ ");
+    }
+    if (r.ruletype == IMPERATIVE) {
+        printf(" ⊢ ");
+    } else {
+        printf(" ⊣ ");
+    }
+    for (int i = 0; i < r.n_atoms_in_head; i++) {
+        printf("%s", atom_name(symbols, r.head[i]));
+        if (i < r.n_atoms_in_head - 1) printf(" ∨ ");
+    }
+}
+
+/* Function for writing a single definite clause (with optional trailing comma). */
+void write_definite_clause(Writer *writer, const SymbolTable *symbols, DefiniteClause c, int with_comma) {
+    writer_puts(writer, atom_name(symbols, c.head));
+    writer_puts(writer, " ← {");
+    for (int i = 0; i < c.n_atoms_in_body; i++) {
+        writer_puts(writer, atom_name(symbols, c.body[i]));
+        if (i < c.n_atoms_in_body - 1) writer_write(writer, ", ", 2);
+    }
+    writer_puts(writer, with_comma ? "}, " : "}");
+}
+
+/* Function for writing a single definite program. */
+void write_definite_program(Writer *writer, const SymbolTable *symbols, DefiniteProgram prog) {
+    writer_write(writer, "{", 1);
+    for (int j = 0; j < prog.n_clauses; j++) {
+        write_definite_clause(writer, symbols, prog.clauses[prog.clause_ids[j]], j < prog.n_clauses - 1);
+    }
+    writer_write(writer, "}", 1);
+}
+
+/* Function for printing defᵣ(r), its programs going through a writer. */
+void print_defr(Writer *writer, const SymbolTable *symbols, DefiniteProgram *sets, int n_sets, Rule rule) {
+    printf("defᵣ(");
+    print_rule(symbols, rule);
+    printf(") = {\n");
+    for (int i = 0; i < n_sets; i++) {
+        writer_write(writer, "  ", 2);
+        write_definite_program(writer, symbols, sets[i]);
+        writer_puts(writer, i < n_sets - 1 ? ",\n" : "\n");
+    }
+    writer_write(writer, "}\n", 2);
+    writer_flush(writer);
+}
+
+/* Visitor for def(R) writing each program as soon as it is produced,
+ * context pointing to a DefPrinter. */
+bool print_def_program(DefiniteProgram program, const int *choice, void *context) {
+    DefPrinter *printer = context;
+    (void)choice;
+    writer_puts(printer->writer, printer->n_printed > 0 ? ",\n  " : "  ");
+    write_definite_program(printer->writer, printer->symbols, program);
+    printer->n_printed++;
+    return true;
+}
+
+/* Function for printing a model to a stream, its atoms in increasing order
+ * of ID, i.e. of name. The sorted names of extra atoms, belonging to the
+ * model without being known to symbols, are merged in. atoms is a buffer
+ * holding at least as many atoms as the model. */
+void fprint_model(FILE *stream, const SymbolTable *symbols, const Model *m, char **extras, int n_extras, Atom *atoms) {
+    int n_atoms = model_atoms(m, atoms);
+    fprintf(stream, "{");
+    int k = 0, e = 0;
+    while (k < n_atoms || e < n_extras) {
+        if (e == n_extras || (k < n_atoms && strcmp(atom_name(symbols, atoms[k]), extras[e]) < 0)) {
+            fprintf(stream, "%s", atom_name(symbols, atoms[k++]));
+        } else {
+            fprintf(stream, "%s", extras[e++]);
+        }
+        if (k < n_atoms || e < n_extras) fprintf(stream, ", ");
+    }
+    fprintf(stream, "}");
+}
+
+/* Function for initializing a model writer to a stream for models over
+ * the atoms of symbols. In the binary format, the stream starts with a
+ * header: the magic bytes "KL1M", the format version, the number of atoms
+ * and of 64-bit words per model, then the name of every atom, by ID, as
+ * its length and its bytes (all integers being little-endian, 32 bits). */
+void init_model_writer(ModelWriter *output, FILE *stream, OutputFormat format, const SymbolTable *symbols) {
+    init_writer(&output->writer, stream);
+    output->format = format;
+    output->symbols = symbols;
+    int n_atoms = symbols->n_symbols;
+    output->name_lengths = safe_malloc((n_atoms > 0 ? n_atoms : 1) * sizeof(size_t));
+    for (Atom a = 0; a < n_atoms; a++) {
+        output->name_lengths[a] = strlen(atom_name(symbols, a));
+    }
+    output->atoms = safe_malloc(model_words_for(n_atoms) * MODEL_WORD_BITS * sizeof(Atom));
+    output->extras = NULL;
+    output->n_extras = 0;
+    output->n_models = 0;
+    if (format == FORMAT_BINARY) {
+        writer_write(&output->writer, "KL1M", 4);
+        writer_put_uint(&output->writer, 1, 4);
+        writer_put_uint(&output->writer, n_atoms, 4);
+        writer_put_uint(&output->writer, model_words_for(n_atoms), 4);
+        for (Atom a = 0; a < n_atoms; a++) {
+            writer_put_uint(&output->writer, output->name_lengths[a], 4);
+            writer_write(&output->writer, atom_name(symbols, a), output->name_lengths[a]);
+        }
+    }
+}
+
+/* Flush a model writer and free its buffers. */
+void free_model_writer(ModelWriter *output) {
+    free_writer(&output->writer);
+    free(output->name_lengths);
+    free(output->atoms);
+}
+
+/* Function for starting a set of models of a stage: its label in the
+ * human format, a "% cnsd" or "% out1" comment line in the lines format,
+ * and the stage number (2 or 4, as 32 bits) in the binary format. */
+void begin_model_set(ModelWriter *output, Stage stage) {
+    output->n_models = 0;
+    if (output->format == FORMAT_HUMAN) {
+        writer_puts(&output->writer, stage == STAGE_CNSD ? "cnsᵈ(R,A) = {\n" : "out₁(R,A) = {\n");
+    } else if (output->format == FORMAT_LINES) {
+        writer_puts(&output->writer, stage == STAGE_CNSD ? "% cnsd\n" : "% out1\n");
+    } else {
+        writer_put_uint(&output->writer, stage, 4);
+    }
+}
+
+/* Function for writing a model in the current set of a model writer: as
+ * "{a, b}" in the human format and "a, b." in the lines format, its atoms
+ * in increasing order of ID, i.e. of name, with the sorted extra atoms
+ * merged in; in the binary format, as the record kind 1 (32 bits) and its
+ * words (64 bits each). */
+void write_model(ModelWriter *output, const Model *m) {
+    Writer *writer = &output->writer;
+    if (output->format == FORMAT_BINARY) {
+        writer_put_uint(writer, 1, 4);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        writer_write(writer, m->words, m->n_words * sizeof(ModelWord));
+#else
+        for (int w = 0; w < m->n_words; w++) {
+            writer_put_uint(writer, m->words[w], 8);
+        }
+#endif
+        output->n_models++;
+        return;
+    }
+    if (output->format == FORMAT_HUMAN) {
+        writer_puts(writer, output->n_models > 0 ? ",\n  {" : "  {");
+    }
+    const SymbolTable *symbols = output->symbols;
+    int n_atoms = model_atoms(m, output->atoms);
+    int k = 0, e = 0;
+    while (k < n_atoms || e < output->n_extras) {
+        if (e == output->n_extras || (k < n_atoms && strcmp(atom_name(symbols, output->atoms[k]), output->extras[e]) < 0)) {
+            Atom a = output->atoms[k++];
+            writer_write(writer, atom_name(symbols, a), output->name_lengths[a]);
+        } else {
+            writer_puts(writer, output->extras[e++]);
+        }
+        if (k < n_atoms || e < output->n_extras) writer_write(writer, ", ", 2);
+    }
+    if (output->format == FORMAT_HUMAN) writer_write(writer, "}", 1);
+    else writer_write(writer, ".\n", 2);
+    output->n_models++;
+}
+
+/* Visitor for models streamed during a search, written by the model
+ * writer context points to. */
+void stream_model(const Model *model, void *context) {
+    write_model(context, model);
+}
+
+/* Function for writing the models of a set in the current set of a model writer. */
+void write_model_set(ModelWriter *output, const ModelSet *set) {
+    for (size_t j = 0; j < set->n_models; j++) {
+        Model m = model_set_at(set, j);
+        write_model(output, &m);
+    }
+}
+
+/* Function for ending the current set of a model writer, with the number
+ * of duplicate models collapsed in it: in the binary format, as the record
+ * kind 0 (32 bits), the number of models and of duplicates (64 bits each).
+ * The writer is flushed. */
+void end_model_set(ModelWriter *output, uint64_t n_duplicates) {
+    if (output->format == FORMAT_HUMAN) {
+        writer_puts(&output->writer, output->n_models > 0 ? "\n}\n" : "}\n");
+    } else if (output->format == FORMAT_BINARY) {
+        writer_put_uint(&output->writer, 0, 4);
+        writer_put_uint(&output->writer, output->n_models, 8);
+        writer_put_uint(&output->writer, n_duplicates, 8);
+    }
+    writer_flush(&output->writer);
+}
+
+/* Function for printing a set of models of a stage, with the extra atoms
+ * merged into each of them. */
+void print_models(ModelWriter *output, Stage stage, const ModelSet *set, char **extras, int n_extras) {
+    output->extras = extras;
+    output->n_extras = n_extras;
+    begin_model_set(output, stage);
+    write_model_set(output, set);
+    end_model_set(output, set->n_duplicates);
+    output->extras = NULL;
+    output->n_extras = 0;
+}
+
+/* Function for reporting how many duplicate models were collapsed. */
+void print_duplicates(uint64_t n_duplicates) {
+    printf("(%" PRIu64 " duplicate model%s collapsed)\n", n_duplicates, n_duplicates == 1 ? "" : "s");
+}
+
+/* Function for printing the models of a stage as the product of the
+ * models of the components of R: every combination of one model per
+ * component, joined with the inert facts, the last component varying
+ * fastest. Combined models are built one at a time and never stored. */
+void print_model_product(ModelWriter *output, const Decomposition *decomposition, Stage stage) {
+    int n_components = decomposition->n_components;
+    size_t *index = safe_malloc((n_components > 0 ? n_components : 1) * sizeof(size_t));
+    int max_atoms = 1;
+    bool empty = false;
+    for (int c = 0; c < n_components; c++) {
+        const Component *component = &decomposition->components[c];
+        const ModelSet *set = stage == STAGE_CNSD ? &component->results.cnsd : &component->results.out1;
+        index[c] = 0;
+        if (component->n_atoms > max_atoms) max_atoms = component->n_atoms;
+        if (set->n_models == 0) empty = true;
+    }
+    Model model = new_model(model_words_for(output->symbols->n_symbols));
+    Atom *local_atoms = safe_malloc(max_atoms * sizeof(Atom));
+    begin_model_set(output, stage);
+    bool more = !empty;
+    while (more) {
+        model_set_atoms(&model, decomposition->inert_facts, decomposition->n_inert_facts);
+        for (int c = 0; c < n_components; c++) {
+            const Component *component = &decomposition->components[c];
+            const ModelSet *set = stage == STAGE_CNSD ? &component->results.cnsd : &component->results.out1;
+            Model local = model_set_at(set, index[c]);
+            int n_local = model_atoms(&local, local_atoms);
+            for (int k = 0; k < n_local; k++) {
+                model_add(&model, component->atoms[local_atoms[k]]);
+            }
+        }
+        write_model(output, &model);
+        
+        /* Advance the choice of models like a mixed-radix counter. */
+        more = false;
+        for (int c = n_components - 1; c >= 0; c--) {
+            const Component *component = &decomposition->components[c];
+            const ModelSet *set = stage == STAGE_CNSD ? &component->results.cnsd : &component->results.out1;
+            if (++index[c] < set->n_models) {
+                more = true;
+                break;
+            }
+            index[c] = 0;
+        }
+    }
+    end_model_set(output, 0);
+    free(local_atoms);
+    free_model(&model);
+    free(index);
+}
+
+/* Function for reading a whitespace-delimited atom name from the user and interning it. */
+Atom read_atom(SymbolTable *symbols) {
+    size_t capacity = 16, length = 0;
+    char *name = safe_malloc(capacity);
+    int c;
+    do {
+        c = getchar();
+    } while (c != EOF && isspace(c));
+    while (c != EOF && !isspace(c)) {
+        if (length + 1 == capacity) {
+            capacity *= 2;
+            name = safe_realloc(name, capacity);
+        }
+        name[length++] = (char)c;
+        c = getchar();
+    }
+    name[length] = '\0';
+    Atom a = intern_atom(symbols, name, length);
+    free(name);
+    return a;
+}
+
+/* Read facts and rules from the user.
+ * Each fact is an atom name, interned in symbols.
+ * Each rule has a body (AND of atoms) and a head (OR of atoms),
+ * and is either imperative (⊢) or permissive (⊣).
+ * A rule with no head atoms and ruletype == IMPERATIVE is treated as a 
+ * constraint (⊢ ⊥).
+ */
+void read_input(SymbolTable *symbols, Atom **facts, int *n_facts, Rule **rules, int *n_rules) {
+    printf("Number of facts: ");
+    scanf("%d", n_facts);
+    *facts = safe_malloc(*n_facts * sizeof(Atom));
+    printf("Enter facts (atom names):\n");
+    for (int i = 0; i < *n_facts; i++) {
+        printf("  Fact %d: ", i + 1);
+        (*facts)[i] = read_atom(symbols);
+    }
+    printf("\nNumber of rules: ");
+    scanf("%d", n_rules);
+    *rules = safe_malloc(*n_rules * sizeof(Rule));
+    for (int i = 0; i < *n_rules; i++) {
+        printf("\n--- Rule %d ---\n", i + 1);
+        
+        /* === Body === */
+        int n_body;
+        printf("  Number of atoms in body: ");
+        scanf("%d", &n_body);
+        Atom *body = safe_malloc(n_body * sizeof(Atom));
+        for (int j = 0; j < n_body; j++) {
+            printf("    Body atom %d: ", j + 1);
+            body[j] = read_atom(symbols);
+        }
+
+        /* === Head === */
+        int n_head;
+        printf("  Number of atoms in head (0 for constraint): ");
+        scanf("%d", &n_head);
+        Atom *head = NULL;
+        if (n_head > 0) {
+            head = safe_malloc(n_head * sizeof(Atom));
+            for (int j = 0; j < n_head; j++) {
+                printf("    Head atom %d: ", j + 1);
+                head[j] = read_atom(symbols);
+            }
+        }
+
+        /* === Rule type === */
+        char type;
+        printf("  Rule type (i = ⊢, p = ⊣): ");
+        scanf(" %c", &type);
+        RuleType ruletype = (type == 'i') ? IMPERATIVE : PERMISSIVE;
+        
+        /* === Store rule (a constraint is encoded as head = {⊥}) === */
+        (*rules)[i] = encode_rule(n_body, n_head, body, head, ruletype);
+        free(body);
+        if (head) free(head);
+    }
+}
+
+/* Function for reading a whole file into memory. "-" reads standard input.
+ * Returns a buffer to be freed, whose length is stored in length, or NULL
+ * (with errno set) if the file cannot be read. */
+char *read_file(const char *path, size_t *length) {
+    FILE *file = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (!file) return NULL;
+    size_t capacity = 1 << 16;
+    char *text = safe_malloc(capacity);
+    *length = 0;
+    size_t n_read;
+    while ((n_read = fread(text + *length, 1, capacity - *length, file)) > 0) {
+        *length += n_read;
+        if (*length == capacity) {
+            capacity *= 2;
+            text = safe_realloc(text, capacity);
+        }
+    }
+    bool failed = ferror(file);
+    if (file != stdin) fclose(file);
+    if (failed) {
+        free(text);
+        return NULL;
+    }
+    return text;
+}
+
+/* Function for recording a syntax error at the cursor of a parser, as
+ * path:line:column: message. Returns false, for parsers to return it. */
+bool parse_error(KbParser *parser, const char *message) {
+    snprintf(parser->error, sizeof(parser->error), "%s:%d:%d: %s", parser->path, parser->line,
+             (int)(parser->cursor - parser->line_start) + 1, message);
+    return false;
+}
+
+/* Function for skipping white space and comments (from % to the end of the line). */
+void skip_blanks(KbParser *parser) {
+    while (parser->cursor < parser->end) {
+        char c = *parser->cursor;
+        if (c == '%') {
+            while (parser->cursor < parser->end && *parser->cursor != '\n') parser->cursor++;
+        } else if (c == '\n') {
+            parser->cursor++;
+            parser->line++;
+            parser->line_start = parser->cursor;
+        } else if (isspace((unsigned char)c)) {
+            parser->cursor++;
+        } else {
+            break;
+        }
+    }
+}
+
+/* Function for checking whether a byte may appear in an atom name:
+ * letters, digits, underscores, primes and any non-ASCII (UTF-8) byte. */
+bool is_atom_char(char c) {
+    unsigned char u = (unsigned char)c;
+    return isalnum(u) || u == '_' || u == '\'' || u >= 0x80;
+}
+
+/* Function for checking whether a name is ⊥, which is no atom: it only
+ * stands for the empty head of a constraint. */
+bool is_bottom(const char *name, size_t length) {
+    return length == strlen("⊥") && memcmp(name, "⊥", length) == 0;
+}
+
+/* Function for parsing a possibly empty list of atoms separated by
+ * separator into a growable buffer. A head ('|'-separated) may be ⊥ alone,
+ * parsed as the empty head. Returns the number of atoms, or -1 on a syntax
+ * error. */
+int parse_atom_list(KbParser *parser, SymbolTable *symbols, char separator, Atom **atoms, int *capacity) {
+    int n_atoms = 0;
+    skip_blanks(parser);
+    if (parser->cursor == parser->end || !is_atom_char(*parser->cursor)) return 0;
+    while (true) {
+        const char *name = parser->cursor;
+        while (parser->cursor < parser->end && is_atom_char(*parser->cursor)) parser->cursor++;
+        if (is_bottom(name, parser->cursor - name)) {
+            skip_blanks(parser);
+            if (separator == '|' && n_atoms == 0 && (parser->cursor == parser->end || *parser->cursor != '|')) return 0;
+            parser->cursor = name;
+            parse_error(parser, separator == '|' ? "'⊥' can only be a head on its own" : "'⊥' is not an atom");
+            return -1;
+        }
+        if (n_atoms == *capacity) {
+            *capacity *= 2;
+            *atoms = safe_realloc(*atoms, *capacity * sizeof(Atom));
+        }
+        (*atoms)[n_atoms++] = intern_atom(symbols, name, parser->cursor - name);
+        skip_blanks(parser);
+        if (parser->cursor == parser->end || *parser->cursor != separator) return n_atoms;
+        parser->cursor++;
+        skip_blanks(parser);
+        if (parser->cursor == parser->end || !is_atom_char(*parser->cursor)) {
+            parse_error(parser, separator == ',' ? "expected an atom after ','" : "expected an atom after '|'");
+            return -1;
+        }
+    }
+}
+
+/* Function for parsing the facts and rules of a knowledge base file into
+ * kb, whose symbol table must be initialized. Files are made of statements
+ * ending with a period:
+ *   a, b.              facts a and b
+ *   a, b -> c | d.     imperative rule a ∧ b ⊢ c ∨ d
+ *   a, b => e.         permissive rule a ∧ b ⊣ e
+ *   a, b -> .          constraint a ∧ b ⊢ ⊥, also written a, b -> ⊥.
+ * Bodies may be empty, and % starts a comment running to the end of the
+ * line. The text is scanned in place. Returns false on a syntax error,
+ * described with its line and column in parser->error; the facts and rules
+ * parsed so far are left in kb.
+ */
+bool parse_kb(KbParser *parser, KnowledgeBase *kb) {
+    int facts_capacity = 16, rules_capacity = 16, body_capacity = 16, head_capacity = 16;
+    kb->facts = safe_malloc(facts_capacity * sizeof(Atom));
+    kb->rules = safe_malloc(rules_capacity * sizeof(Rule));
+    kb->n_facts = 0;
+    kb->n_rules = 0;
+    Atom *body = safe_malloc(body_capacity * sizeof(Atom));
+    Atom *head = safe_malloc(head_capacity * sizeof(Atom));
+    bool parsed = true;
+    while (parsed) {
+        skip_blanks(parser);
+        if (parser->cursor == parser->end) break;
+        int n_body = parse_atom_list(parser, &kb->symbols, ',', &body, &body_capacity);
+        const char *arrow = parser->cursor;
+        if (n_body < 0) {
+            parsed = false;
+        } else if (parser->end - arrow >= 2 && (arrow[0] == '-' || arrow[0] == '=') && arrow[1] == '>') {
+            
+            /* Rule: the body is followed by -> (⊢) or => (⊣) and the head. */
+            RuleType ruletype = arrow[0] == '-' ? IMPERATIVE : PERMISSIVE;
+            parser->cursor += 2;
+            int n_head = parse_atom_list(parser, &kb->symbols, '|', &head, &head_capacity);
+            if (n_head < 0) {
+                parsed = false;
+            } else if (parser->cursor == parser->end || *parser->cursor != '.') {
+                parsed = parse_error(parser, n_head > 0 ? "expected '|' or '.' after a head atom" : "expected a head atom or '.'");
+            } else {
+                if (kb->n_rules == rules_capacity) {
+                    rules_capacity *= 2;
+                    kb->rules = safe_realloc(kb->rules, rules_capacity * sizeof(Rule));
+                }
+                kb->rules[kb->n_rules++] = encode_rule(n_body, n_head, body, head, ruletype);
+            }
+        } else if (parser->cursor < parser->end && *parser->cursor == '.') {
+            
+            /* Facts. */
+            if (n_body == 0) {
+                parsed = parse_error(parser, "expected an atom or a rule before '.'");
+            } else {
+                while (kb->n_facts + n_body > facts_capacity) {
+                    facts_capacity *= 2;
+                    kb->facts = safe_realloc(kb->facts, facts_capacity * sizeof(Atom));
+                }
+                memcpy(kb->facts + kb->n_facts, body, n_body * sizeof(Atom));
+                kb->n_facts += n_body;
+            }
+        } else if (n_body == 0) {
+            parsed = parse_error(parser, "expected an atom, '->' or '=>'");
+        } else {
+            parsed = parse_error(parser, "expected ',', '->', '=>' or '.' after an atom");
+        }
+        
+        /* Skip the period. */
+        parser->cursor++;
+    }
+    free(body);
+    free(head);
+    return parsed;
+}
+
+/* Function for opening a reader of queries on a file ("-" for standard input). */
+void open_query_reader(QueryReader *reader, const char *path) {
+    reader->file = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (!reader->file) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    reader->path = path;
+    reader->line = 0;
+    reader->buffer = NULL;
+    reader->capacity = 0;
+}
+
+/* Close a reader of queries. */
+void close_query_reader(QueryReader *reader) {
+    if (reader->file != stdin) fclose(reader->file);
+    free(reader->buffer);
+}
+
+/* Function for parsing a query: a comma-separated fact set with an
+ * optional final period ("." alone is the empty set), added to the facts
+ * of the knowledge base. The facts are kept without repetitions, a set of
+ * the facts seen so far telling which atoms are already there. Atoms
+ * unknown to symbols are kept by name among the extras, sorted and without
+ * repetitions. Returns false on a syntax error, described in
+ * parser->error, leaving nothing allocated. */
+bool parse_query(KbParser *parser, const SymbolTable *symbols, const Atom *base_facts, int n_base_facts, Query *query) {
+    int facts_capacity = n_base_facts + 8, extras_capacity = 4;
+    Model seen = new_model(model_words_for(symbols->n_symbols));
+    query->facts = safe_malloc(facts_capacity * sizeof(Atom));
+    query->n_facts = 0;
+    for (int f = 0; f < n_base_facts; f++) {
+        if (model_contains(&seen, base_facts[f])) continue;
+        model_add(&seen, base_facts[f]);
+        query->facts[query->n_facts++] = base_facts[f];
+    }
+    query->extras = safe_malloc(extras_capacity * sizeof(char *));
+    query->n_extras = 0;
+    skip_blanks(parser);
+    bool parsed = true;
+    while (parsed && parser->cursor < parser->end && *parser->cursor != '.') {
+        if (!is_atom_char(*parser->cursor)) {
+            parsed = parse_error(parser, "expected an atom");
+            break;
+        }
+        const char *name = parser->cursor;
+        while (parser->cursor < parser->end && is_atom_char(*parser->cursor)) parser->cursor++;
+        size_t length = parser->cursor - name;
+        if (is_bottom(name, length)) {
+            parser->cursor = name;
+            parsed = parse_error(parser, "'⊥' is not an atom");
+            break;
+        }
+        Atom a = find_atom(symbols, name, length);
+        if (a >= 0) {
+            if (!model_contains(&seen, a)) {
+                model_add(&seen, a);
+                if (query->n_facts == facts_capacity) {
+                    facts_capacity *= 2;
+                    query->facts = safe_realloc(query->facts, facts_capacity * sizeof(Atom));
+                }
+                query->facts[query->n_facts++] = a;
+            }
+        } else {
+            if (query->n_extras == extras_capacity) {
+                extras_capacity *= 2;
+                query->extras = safe_realloc(query->extras, extras_capacity * sizeof(char *));
+            }
+            char *extra = safe_malloc(length + 1);
+            memcpy(extra, name, length);
+            extra[length] = '\0';
+            query->extras[query->n_extras++] = extra;
+        }
+        skip_blanks(parser);
+        if (parser->cursor < parser->end && *parser->cursor == ',') {
+            parser->cursor++;
+            skip_blanks(parser);
+            if (parser->cursor == parser->end || !is_atom_char(*parser->cursor)) parsed = parse_error(parser, "expected an atom after ','");
+        } else if (parser->cursor < parser->end && *parser->cursor != '.') {
+            parsed = parse_error(parser, "expected ',' or '.' after an atom");
+        }
+    }
+    if (parsed && parser->cursor < parser->end) {
+        parser->cursor++;
+        skip_blanks(parser);
+        if (parser->cursor < parser->end) parsed = parse_error(parser, "unexpected text after '.'");
+    }
+    free_model(&seen);
+    if (!parsed) {
+        free_query_atoms(query);
+        return false;
+    }
+    
+    /* Sort the extras and drop repetitions. */
+    qsort(query->extras, query->n_extras, sizeof(char *), compare_names);
+    int n_extras = 0;
+    for (int i = 0; i < query->n_extras; i++) {
+        if (n_extras > 0 && strcmp(query->extras[n_extras - 1], query->extras[i]) == 0) {
+            free(query->extras[i]);
+        } else {
+            query->extras[n_extras++] = query->extras[i];
+        }
+    }
+    query->n_extras = n_extras;
+    return true;
+}
+
+/* Function for reading up to max_queries queries, one per line, skipping
+ * lines that are blank or only hold a comment.
+ * Returns the number of queries read, 0 at the end of the file. */
+int read_queries(QueryReader *reader, const SymbolTable *symbols, const Atom *base_facts, int n_base_facts,
+                 Query *queries, int max_queries) {
+    int n_queries = 0;
+    ssize_t length;
+    while (n_queries < max_queries && (length = getline(&reader->buffer, &reader->capacity, reader->file)) >= 0) {
+        reader->line++;
+        KbParser parser = { reader->path, reader->buffer, reader->buffer, reader->buffer + length, reader->line, reader->buffer, "" };
+        skip_blanks(&parser);
+        if (parser.cursor == parser.end) continue;
+        if (!parse_query(&parser, symbols, base_facts, n_base_facts, &queries[n_queries])) {
+            fprintf(stderr, "%s\n", parser.error);
+            exit(EXIT_FAILURE);
+        }
+        queries[n_queries++].line = reader->line;
+    }
+    return n_queries;
+}
+
+/* Function for writing n distinct pseudo-random atoms among p0 .. p(n_atoms - 1),
+ * separated by separator. */
+void generate_atoms(FILE *stream, const GeneratorSpec *spec, uint64_t *state, int n, const char *separator,
+                    int *picked) {
+    for (int i = 0; i < n; i++) {
+        
+        /* Partial Fisher-Yates shuffle of the atoms. */
+        int j = i + random_below(state, spec->n_atoms - i);
+        int atom = picked[j];
+        picked[j] = picked[i];
+        picked[i] = atom;
+        fprintf(stream, "%sp%d", i > 0 ? separator : "", atom);
+    }
+}
+
+/* Function for writing a pseudo-random knowledge base in the syntax of
+ * knowledge base files. The same spec, seed included, always gives the
+ * same knowledge base. */
+void generate_kb(FILE *stream, const GeneratorSpec *spec) {
+    uint64_t state = spec->seed;
+    int *picked = safe_malloc(spec->n_atoms * sizeof(int));
+    for (int a = 0; a < spec->n_atoms; a++) {
+        picked[a] = a;
+    }
+    fprintf(stream, "%% atoms=%d,rules=%d,facts=%d,body=%d,head=%d,permissive=%g,constraints=%g,chain=%d,seed=%" PRIu64 "\n",
+            spec->n_atoms, spec->n_rules, spec->n_facts, spec->body_width, spec->head_width, spec->permissive,
+            spec->constraints, spec->chain_depth, spec->seed);
+    if (spec->chain_depth > 0) fprintf(stream, "p0.\n");
+    if (spec->n_facts > 0) {
+        generate_atoms(stream, spec, &state, spec->n_facts, ", ", picked);
+        fprintf(stream, ".\n");
+    }
+    for (int i = 0; i < spec->n_rules; i++) {
+        if (i < spec->chain_depth) {
+            fprintf(stream, "p%d -> p%d.\n", i, i + 1);
+        } else if (random_unit(&state) < spec->constraints) {
+            generate_atoms(stream, spec, &state, 1 + random_below(&state, spec->body_width), ", ", picked);
+            fprintf(stream, " -> .\n");
+        } else {
+            generate_atoms(stream, spec, &state, random_below(&state, spec->body_width + 1), ", ", picked);
+            fprintf(stream, random_unit(&state) < spec->permissive ? " => " : " -> ");
+            generate_atoms(stream, spec, &state, 1 + random_below(&state, spec->head_width), " | ", picked);
+            fprintf(stream, ".\n");
+        }
+    }
+    free(picked);
+}
+
+/* * * * * * * * * * * * * * * * * * * Session * * * * * * * * * * * * * * * * * * * * */
+
+/* Utility function to print a separator line for output sections. */
+void print_separator(void) {
+    printf("===========================================================\n");
+}
+
+/* Function to display all input facts and rules. */
+void print_knowledge_base(const KnowledgeBase *kb) {
+    print_atoms(&kb->symbols, kb->facts, kb->n_facts);
+    printf("R:\n");
+    for (int i = 0; i < kb->n_rules; i++) {
+        print_rule(&kb->symbols, kb->rules[i]);
+        printf("\n");
+    }
+}
+
+/* Function for printing the result block of a query: its fact set, then
+ * out₁(R,A) or, in count mode, only its cardinality. */
+void print_query(ModelWriter *output, const Query *query, int index, bool count_only) {
+    const SymbolTable *symbols = output->symbols;
+    if (count_only) {
+        printf("Query %d: |out₁(R,A)| = %zu\n", index, query->out1.n_models);
+        return;
+    }
+    print_separator();
+    printf("Query %d: A = {", index);
+    for (int i = 0; i < query->n_facts; i++) {
+        printf("%s%s", atom_name(symbols, query->facts[i]), i < query->n_facts - 1 || query->n_extras > 0 ? ", " : "");
+    }
+    for (int i = 0; i < query->n_extras; i++) {
+        printf("%s%s", query->extras[i], i < query->n_extras - 1 ? ", " : "");
+    }
+    printf("}\n");
+    print_models(output, STAGE_OUT1, &query->out1, query->extras, query->n_extras);
+    print_duplicates(query->out1.n_duplicates);
+}
+
+/* Function for renumbering the atoms of the facts and rules of a
+ * knowledge base: atom a becomes renumber[a]. */
+void renumber_atoms(KnowledgeBase *kb, const Atom *renumber) {
+    for (int i = 0; i < kb->n_facts; i++) {
+        kb->facts[i] = renumber[kb->facts[i]];
+    }
+    for (int i = 0; i < kb->n_rules; i++) {
+        Rule *r = &kb->rules[i];
+        for (int j = 0; j < r->n_atoms_in_body; j++) {
+            r->body[j] = renumber[r->body[j]];
+        }
+        for (int j = 0; j < r->n_atoms_in_head; j++) {
+            if (r->head[j] != BOTTOM) r->head[j] = renumber[r->head[j]];
+        }
+    }
+}
+
+/* Function for numbering the atoms of a knowledge base in alphabetical
+ * order of their names, so that models print in that order. */
+void number_atoms_by_name(KnowledgeBase *kb) {
+    Atom *renumber = safe_malloc((kb->symbols.n_symbols > 0 ? kb->symbols.n_symbols : 1) * sizeof(Atom));
+    sort_symbol_table(&kb->symbols, renumber);
+    renumber_atoms(kb, renumber);
+    free(renumber);
+}
+
+/* Free all memory associated with a KnowledgeBase (facts, rules and atom names). */
+void free_knowledge_base(KnowledgeBase *kb) {
+    free_rules(kb->rules, kb->n_rules);
+    free(kb->facts);
+    free_symbol_table(&kb->symbols);
+}
+
+/* Function for loading a knowledge base from the text of a file, named
+ * path in error messages, its atoms numbered by name. Returns false, with
+ * a message in error and nothing left allocated, on a syntax error. */
+bool load_kb_text(const char *path, const char *text, size_t length, KnowledgeBase *kb, char *error, size_t error_size) {
+    KbParser parser = { path, text, text, text + length, 1, text, "" };
+    init_symbol_table(&kb->symbols);
+    if (!parse_kb(&parser, kb)) {
+        snprintf(error, error_size, "%s", parser.error);
+        free_knowledge_base(kb);
+        return false;
+    }
+    number_atoms_by_name(kb);
+    return true;
+}
+
+/* Function for loading a knowledge base from a file ("-" for standard
+ * input). Returns false, with a message in error and nothing left
+ * allocated, if the file cannot be read or parsed. */
+bool load_kb_file(const char *path, KnowledgeBase *kb, char *error, size_t error_size) {
+    size_t length;
+    char *text = read_file(path, &length);
+    if (!text) {
+        snprintf(error, error_size, "%s: %s", path, strerror(errno));
+        return false;
+    }
+    bool loaded = load_kb_text(path, text, length, kb, error, error_size);
+    free(text);
+    return loaded;
+}
+
+/* Function for printing the command-line usage. */
+void print_usage(const char *program) {
+    fprintf(stderr, "Usage: %s [--input FILE] [--queries FILE] [--threads N] [--stages LIST] [--count] [--reduce]\n"
+                    "          [--components] [--stats] [--format FORMAT] [--engine ENGINE]\n", program);
+    fprintf(stderr, "       %s [--input FILE] [--credulous ATOMS] [--skeptical ATOMS] [--member MODEL] [--minimal]\n"
+                    "          [--format FORMAT]\n", program);
+    fprintf(stderr, "       %s [--input FILE] --updates FILE [--count]\n", program);
+    fprintf(stderr, "       %s --serve SOCKET --input FILE [--threads N]\n", program);
+    fprintf(stderr, "       %s --client SOCKET [--queries FILE] [--threads N]\n", program);
+    fprintf(stderr, "       %s [--input FILE] [--limit K] [--time-budget MS] [--stages STAGE] [--count] [--reduce]\n"
+                    "          [--format FORMAT]\n", program);
+    fprintf(stderr, "       %s [--input FILE] --max-memory MB [--threads N] [--stages LIST] [--count] [--reduce]\n"
+                    "          [--format FORMAT]\n", program);
+    fprintf(stderr, "       %s --generate PARAMS\n", program);
+    fprintf(stderr, "       %s --bench (--input FILE | --generate PARAMS) [--threads N]\n", program);
+    fprintf(stderr, "  --input FILE    read A and R from a knowledge base file (- for standard\n");
+    fprintf(stderr, "                  input) instead of prompting for them\n");
+    fprintf(stderr, "  --queries FILE  compile R once, then print out₁(R,A) for every fact set A\n");
+    fprintf(stderr, "                  of FILE (- for standard input), one comma-separated set\n");
+    fprintf(stderr, "                  per line, added to the facts of the knowledge base;\n");
+    fprintf(stderr, "                  queries are spread over the --threads\n");
+    fprintf(stderr, "  --threads N     compute cnsᵈ(R,A) and out₁(R,A) on N threads (default 1;\n");
+    fprintf(stderr, "                  def(R) is always printed sequentially)\n");
+    fprintf(stderr, "  --stages LIST   comma-separated stages to compute and print, among\n");
+    fprintf(stderr, "                  def, cnsd and out1 (default: all)\n");
+    fprintf(stderr, "  --count         only print |def(R)|, |cnsᵈ(R,A)| and |out₁(R,A)| for the\n");
+    fprintf(stderr, "                  requested stages; |def(R)| is computed in closed form\n");
+    fprintf(stderr, "  --serve SOCKET  load and compile the knowledge base once, then answer the\n");
+    fprintf(stderr, "                  requests of clients on a Unix socket, one per line:\n");
+    fprintf(stderr, "                    out1 FACTS | cnsd FACTS | reload [FILE] | quit | shutdown\n");
+    fprintf(stderr, "                  with --threads workers serving one client each\n");
+    fprintf(stderr, "  --client SOCKET send the requests of --queries (default: standard input)\n");
+    fprintf(stderr, "                  to a server over --threads connections, print the\n");
+    fprintf(stderr, "                  responses in order and the throughput on stderr\n");
+    fprintf(stderr, "  --reduce        before searching def(R), drop dead rules and keep one option\n");
+    fprintf(stderr, "                  of defᵣ(r) per class of equivalent ones for A, and report\n");
+    fprintf(stderr, "                  the shrinkage on stderr (not with the def stage)\n");
+    fprintf(stderr, "  --components    split R into components sharing no atom, search each one on\n");
+    fprintf(stderr, "                  its own, and count or print their product (not with the\n");
+    fprintf(stderr, "                  def stage; models are then listed in product order)\n");
+    fprintf(stderr, "  --stats         print counters and timers of the run as JSON on stderr\n");
+    fprintf(stderr, "                  (only when compiled with -DKL1_STATS)\n");
+    fprintf(stderr, "  --format FORMAT write the models of cnsᵈ(R,A) and out₁(R,A) as they are found\n");
+    fprintf(stderr, "                  (on one thread) in the human format (default), one per line\n");
+    fprintf(stderr, "                  as queries (lines), or as bitsets (binary); the last two\n");
+    fprintf(stderr, "                  leave out the knowledge base and def(R)\n");
+    fprintf(stderr, "  --engine ENGINE compute cnsᵈ(R,A) and out₁(R,A) by enumerating def(R)\n");
+    fprintf(stderr, "                  (enumerate, the default), with a conflict-driven solver\n");
+    fprintf(stderr, "                  searching models directly (solver; without def(R), and\n");
+    fprintf(stderr, "                  listing models in the order found), or both, checking\n");
+    fprintf(stderr, "                  that they agree (check)\n");
+    fprintf(stderr, "  --credulous ATOMS\n");
+    fprintf(stderr, "                  tell whether each atom of a comma-separated list is in some\n");
+    fprintf(stderr, "                  model of out₁(R,A), with the first witness found\n");
+    fprintf(stderr, "  --skeptical ATOMS\n");
+    fprintf(stderr, "                  tell whether each atom is in every model of out₁(R,A), with\n");
+    fprintf(stderr, "                  the first counterexample found\n");
+    fprintf(stderr, "  --member MODEL  tell whether a comma-separated set of atoms is in out₁(R,A)\n");
+    fprintf(stderr, "  --minimal       print the ⊆-minimal models of out₁(R,A), each one excluding\n");
+    fprintf(stderr, "                  its supersets from the search; questions are answered with\n");
+    fprintf(stderr, "                  the solver, in this order, without enumerating out₁(R,A)\n");
+    fprintf(stderr, "  --updates FILE  print out₁(R,A), then maintain it as the facts and rules of\n");
+    fprintf(stderr, "                  FILE (- for standard input) are added (+ a. or + a -> b.)\n");
+    fprintf(stderr, "                  or retracted (- a. or - a -> b.), one per line, printing the\n");
+    fprintf(stderr, "                  models each update adds and removes\n");
+    fprintf(stderr, "  --limit K       stop the search once K models are found\n");
+    fprintf(stderr, "  --time-budget MS\n");
+    fprintf(stderr, "                  stop the search MS milliseconds after it starts, once the\n");
+    fprintf(stderr, "                  knowledge base is read and compiled;\n");
+    fprintf(stderr, "                  with either, models stream as they are found, only out₁(R,A)\n");
+    fprintf(stderr, "                  is searched unless --stages picks cnsd, and the share of\n");
+    fprintf(stderr, "                  def(R) covered is reported on stderr\n");
+    fprintf(stderr, "  --max-memory MB keep the sets of cnsᵈ(R,A) and out₁(R,A) within about MB\n");
+    fprintf(stderr, "                  megabytes, spilling sorted runs of models to temporary files\n");
+    fprintf(stderr, "                  and merging them at the end; spilled models are listed in\n");
+    fprintf(stderr, "                  the order of their bitsets, not streamed; every set, one per\n");
+    fprintf(stderr, "                  stage and thread, needs room for %d models\n", MIN_MODELS_IN_MEMORY);
+    fprintf(stderr, "  --generate PARAMS\n");
+    fprintf(stderr, "                  print a pseudo-random knowledge base, or benchmark it with\n");
+    fprintf(stderr, "                  --bench; PARAMS is a comma-separated list of key=value\n");
+    fprintf(stderr, "                  among atoms, rules, facts, body and head (widths),\n");
+    fprintf(stderr, "                  permissive and constraints (ratios), chain and seed\n");
+    fprintf(stderr, "  --bench         time loading, compiling, defR, least_model, cns_star and out\n");
+    fprintf(stderr, "                  and print the timings, throughputs and peak RSS as JSON\n");
+}
+
+/* Function for parsing a comma-separated list of stages.
+ * Returns 0 if the list contains an unknown stage. */
+int parse_stages(const char *list) {
+    int stages = 0;
+    while (*list) {
+        size_t length = strcspn(list, ",");
+        if (length == 3 && strncmp(list, "def", 3) == 0) stages |= STAGE_DEF;
+        else if (length == 4 && strncmp(list, "cnsd", 4) == 0) stages |= STAGE_CNSD;
+        else if (length == 4 && strncmp(list, "out1", 4) == 0) stages |= STAGE_OUT1;
+        else return 0;
+        list += length;
+        if (*list == ',') list++;
+    }
+    return stages;
+}
+
+/* Function for parsing the parameters of the generator of knowledge
+ * bases, a comma-separated list of key=value pairs, over the defaults.
+ * Returns false if a key is unknown or the parameters are inconsistent. */
+bool parse_generator_spec(const char *list, GeneratorSpec *spec) {
+    spec->n_atoms = 16;
+    spec->n_rules = 12;
+    spec->n_facts = 2;
+    spec->body_width = 2;
+    spec->head_width = 2;
+    spec->permissive = 0.25;
+    spec->constraints = 0.1;
+    spec->chain_depth = 4;
+    spec->seed = 1;
+    while (*list) {
+        size_t length = strcspn(list, ",");
+        const char *equals = memchr(list, '=', length);
+        if (!equals) return false;
+        size_t key_length = equals - list;
+        char *end;
+        double value = strtod(equals + 1, &end);
+        if (end != list + length || end == equals + 1 || value < 0) return false;
+        if (key_length == 5 && strncmp(list, "atoms", 5) == 0) spec->n_atoms = (int)value;
+        else if (key_length == 5 && strncmp(list, "rules", 5) == 0) spec->n_rules = (int)value;
+        else if (key_length == 5 && strncmp(list, "facts", 5) == 0) spec->n_facts = (int)value;
+        else if (key_length == 4 && strncmp(list, "body", 4) == 0) spec->body_width = (int)value;
+        else if (key_length == 4 && strncmp(list, "head", 4) == 0) spec->head_width = (int)value;
+        else if (key_length == 10 && strncmp(list, "permissive", 10) == 0) spec->permissive = value;
+        else if (key_length == 11 && strncmp(list, "constraints", 11) == 0) spec->constraints = value;
+        else if (key_length == 5 && strncmp(list, "chain", 5) == 0) spec->chain_depth = (int)value;
+        else if (key_length == 4 && strncmp(list, "seed", 4) == 0) spec->seed = (uint64_t)value;
+        else return false;
+        list += length;
+        if (*list == ',') list++;
+    }
+    return spec->n_atoms >= 1 && spec->n_atoms <= 100000000 && spec->n_rules <= 100000000 &&
+           spec->n_facts <= spec->n_atoms && spec->body_width <= spec->n_atoms &&
+           spec->head_width >= 1 && spec->head_width <= spec->n_atoms && spec->head_width <= MAX_ENUMERABLE_HEAD_ATOMS &&
+           spec->permissive <= 1 && spec->constraints <= 1 && (spec->constraints == 0 || spec->body_width >= 1) &&
+           spec->chain_depth <= spec->n_rules && spec->chain_depth < spec->n_atoms;
+}
+
+/* Function for parsing command-line options.
+ * Prints the usage and exits on malformed options. */
+Options parse_options(int argc, char **argv) {
+    Options options;
+    options.n_threads = 1;
+    options.stages = ALL_STAGES;
+    options.count_only = false;
+    options.input_path = NULL;
+    options.queries_path = NULL;
+    options.serve_path = NULL;
+    options.client_path = NULL;
+    options.stats = false;
+    options.reduce = false;
+    options.components = false;
+    options.generate = false;
+    options.bench = false;
+    options.format = FORMAT_HUMAN;
+    options.engine = ENGINE_ENUMERATE;
+    options.credulous = NULL;
+    options.skeptical = NULL;
+    options.member = NULL;
+    options.minimal = false;
+    options.updates_path = NULL;
+    options.budget.max_models = 0;
+    options.budget.time_budget_ms = 0;
+    options.budget.max_memory = 0;
+    bool stages_given = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            char *end;
+            long n = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || n < 1 || n > 4096) {
+                fprintf(stderr, "Invalid number of threads: %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+            options.n_threads = (int)n;
+        } else if (strcmp(argv[i], "--limit") == 0 && i + 1 < argc) {
+            char *end;
+            long n = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || n < 1 || n > INT_MAX) {
+                fprintf(stderr, "Invalid limit: %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+            options.budget.max_models = (int)n;
+        } else if (strcmp(argv[i], "--time-budget") == 0 && i + 1 < argc) {
+            char *end;
+            long ms = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || ms < 1) {
+                fprintf(stderr, "Invalid time budget: %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+            options.budget.time_budget_ms = ms;
+        } else if (strcmp(argv[i], "--max-memory") == 0 && i + 1 < argc) {
+            char *end;
+            long mb = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || mb < 1 || mb > (1L << 24)) {
+                fprintf(stderr, "Invalid memory budget: %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+            options.budget.max_memory = (size_t)mb << 20;
+        } else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc) {
+            options.input_path = argv[++i];
+        } else if (strcmp(argv[i], "--queries") == 0 && i + 1 < argc) {
+            options.queries_path = argv[++i];
+        } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            options.serve_path = argv[++i];
+        } else if (strcmp(argv[i], "--client") == 0 && i + 1 < argc) {
+            options.client_path = argv[++i];
+        } else if (strcmp(argv[i], "--generate") == 0 && i + 1 < argc) {
+            options.generate = true;
+            if (!parse_generator_spec(argv[++i], &options.generator)) {
+                fprintf(stderr, "Invalid generator parameters: %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        } else if (strcmp(argv[i], "--stats") == 0) {
+#ifndef KL1_STATS
+            fprintf(stderr, "--stats needs kl1 compiled with -DKL1_STATS\n");
+            exit(EXIT_FAILURE);
+#endif
+            options.stats = true;
+        } else if (strcmp(argv[i], "--reduce") == 0) {
+            options.reduce = true;
+        } else if (strcmp(argv[i], "--components") == 0) {
+            options.components = true;
+        } else if (strcmp(argv[i], "--bench") == 0) {
+            options.bench = true;
+        } else if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "enumerate") == 0) options.engine = ENGINE_ENUMERATE;
+            else if (strcmp(argv[i], "solver") == 0) options.engine = ENGINE_SOLVER;
+            else if (strcmp(argv[i], "check") == 0) options.engine = ENGINE_CHECK;
+            else {
+                fprintf(stderr, "Unknown engine: %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "human") == 0) options.format = FORMAT_HUMAN;
+            else if (strcmp(argv[i], "lines") == 0) options.format = FORMAT_LINES;
+            else if (strcmp(argv[i], "binary") == 0) options.format = FORMAT_BINARY;
+            else {
+                fprintf(stderr, "Unknown output format: %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        } else if (strcmp(argv[i], "--credulous") == 0 && i + 1 < argc) {
+            options.credulous = argv[++i];
+        } else if (strcmp(argv[i], "--skeptical") == 0 && i + 1 < argc) {
+            options.skeptical = argv[++i];
+        } else if (strcmp(argv[i], "--member") == 0 && i + 1 < argc) {
+            if (options.member) {
+                fprintf(stderr, "--member asks about one model: give it once\n");
+                exit(EXIT_FAILURE);
+            }
+            options.member = argv[++i];
+        } else if (strcmp(argv[i], "--minimal") == 0) {
+            options.minimal = true;
+        } else if (strcmp(argv[i], "--updates") == 0 && i + 1 < argc) {
+            options.updates_path = argv[++i];
+        } else if (strcmp(argv[i], "--count") == 0) {
+            options.count_only = true;
+        } else if (strcmp(argv[i], "--stages") == 0 && i + 1 < argc) {
+            options.stages = parse_stages(argv[++i]);
+            stages_given = true;
+            if (options.stages == 0) {
+                fprintf(stderr, "Invalid list of stages: %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        } else {
+            print_usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    
+    /* Only the models of a single run come in other formats than human. */
+    if (options.format != FORMAT_HUMAN) {
+        if (options.count_only || options.queries_path || options.serve_path || options.client_path || options.bench ||
+            options.generate || (stages_given && (options.stages & STAGE_DEF))) {
+            fprintf(stderr, "--format lines and binary only apply to cnsᵈ(R,A) and out₁(R,A) of a single run,\n"
+                            "not to def(R), counts, queries, servers or benchmarks\n");
+            exit(EXIT_FAILURE);
+        }
+        options.stages &= ~STAGE_DEF;
+    }
+    
+    /* The solver finds the models of cnsᵈ(R,A) and out₁(R,A) of a single run, not def(R). */
+    if (options.engine != ENGINE_ENUMERATE) {
+        if (options.queries_path || options.serve_path || options.client_path || options.bench || options.generate ||
+            options.reduce || options.components ||
+            (options.engine == ENGINE_SOLVER && stages_given && (options.stages & STAGE_DEF) && !options.count_only)) {
+            fprintf(stderr, "--engine solver and check only apply to cnsᵈ(R,A) and out₁(R,A) of a single run,\n"
+                            "not to def(R), queries, servers, benchmarks, --reduce or --components\n");
+            exit(EXIT_FAILURE);
+        }
+        if (options.engine == ENGINE_SOLVER && !options.count_only) options.stages &= ~STAGE_DEF;
+    }
+    
+    /* Questions are answered by the solver about out₁(R,A) of a single run. */
+    if (options.credulous || options.skeptical || options.member || options.minimal) {
+        if (options.count_only || stages_given || options.engine != ENGINE_ENUMERATE || options.queries_path ||
+            options.serve_path || options.client_path || options.bench || options.generate || options.reduce ||
+            options.components) {
+            fprintf(stderr, "--credulous, --skeptical, --member and --minimal are answered about out₁(R,A) of a single run,\n"
+                            "not with --count, --stages, --engine, queries, servers, benchmarks, --reduce or --components\n");
+            exit(EXIT_FAILURE);
+        }
+        if (options.format != FORMAT_HUMAN && (options.credulous || options.skeptical || options.member)) {
+            fprintf(stderr, "--format lines and binary only apply to --minimal among questions\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    
+    /* Updates maintain out₁(R,A) of a single run, with one solver. */
+    if (options.updates_path &&
+        (stages_given || options.n_threads > 1 || options.engine != ENGINE_ENUMERATE || options.format != FORMAT_HUMAN || options.queries_path ||
+         options.serve_path || options.client_path || options.bench || options.generate || options.reduce ||
+         options.components || options.credulous || options.skeptical || options.member || options.minimal)) {
+        fprintf(stderr, "--updates maintains out₁(R,A) of a single run, on one thread, in the human format,\n"
+                        "and only combines with --count\n");
+        exit(EXIT_FAILURE);
+    }
+    
+    /* Budgets cut short the search of def(R) for a single stage, out₁(R,A) by default. */
+    if (options.budget.max_models > 0 || options.budget.time_budget_ms > 0) {
+        if (!stages_given) options.stages = STAGE_OUT1;
+        int model_stages = options.stages & (STAGE_CNSD | STAGE_OUT1);
+        if ((model_stages != STAGE_CNSD && model_stages != STAGE_OUT1) || ((options.stages & STAGE_DEF) && !options.count_only) ||
+            options.n_threads > 1 || options.engine != ENGINE_ENUMERATE || options.queries_path || options.serve_path ||
+            options.client_path || options.bench || options.generate || options.components || options.credulous ||
+            options.skeptical || options.member || options.minimal || options.updates_path) {
+            fprintf(stderr, "--limit and --time-budget apply to the search of def(R) for cnsᵈ(R,A) or out₁(R,A) alone,\n"
+                            "on one thread, in a single run without --components or --engine\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    
+    /* The memory budget bounds the model sets of a single run of the enumeration. */
+    if (options.budget.max_memory > 0 &&
+        (options.engine != ENGINE_ENUMERATE || options.queries_path || options.serve_path || options.client_path ||
+         options.bench || options.generate || options.components || options.credulous || options.skeptical ||
+         options.member || options.minimal || options.updates_path || options.budget.max_models > 0 ||
+         options.budget.time_budget_ms > 0)) {
+        fprintf(stderr, "--max-memory bounds the model sets of a single run enumerating def(R), without --engine,\n"
+                        "queries, servers, benchmarks, --components, questions, --updates, --limit or --time-budget\n");
+        exit(EXIT_FAILURE);
+    }
+    if ((options.reduce || options.components) &&
+        (options.queries_path || options.serve_path || options.client_path || options.bench ||
+         ((options.stages & STAGE_DEF) && !options.count_only))) {
+        fprintf(stderr, "--reduce and --components only apply to cnsᵈ(R,A) and out₁(R,A) of a single run:\n"
+                        "use them with --count, or with --stages not including def, which is printed in full\n");
+        exit(EXIT_FAILURE);
+    }
+    if (options.bench && !options.generate && !options.input_path) {
+        fprintf(stderr, "--bench needs a knowledge base, given with --input or --generate\n");
+        exit(EXIT_FAILURE);
+    }
+    if (options.serve_path && (!options.input_path || strcmp(options.input_path, "-") == 0)) {
+        fprintf(stderr, "--serve needs a knowledge base file given with --input\n");
+        exit(EXIT_FAILURE);
+    }
+    return options;
 }
 
-/* Function for printing defᵣ(r). */
-void print_defr(DefiniteProgram *sets, int n_sets, Rule rule) {
-    printf("defᵣ(");
-    print_rule(rule);
-    printf(") = {\n");
-    for (int i = 0; i < n_sets; i++) {
-        printf("  ");
-        print_definite_program(sets[i]);
-        if (i < n_sets - 1) printf(",\n");
-        else printf("\n");
+/* Function for reporting on stderr how much the program space shrank. */
+void print_reduction(const ProgramSpaceReduction *reduction) {
+    fprintf(stderr, "Program space reduced: ");
+    if (reduction->n_programs_before_overflows) fprintf(stderr, "|def(R)| ≥ 2^64");
+    else fprintf(stderr, "|def(R)| = %" PRIu64, reduction->n_programs_before);
+    if (reduction->n_programs_after_overflows) fprintf(stderr, " -> ≥ 2^64 programs");
+    else fprintf(stderr, " -> %" PRIu64 " program%s", reduction->n_programs_after, reduction->n_programs_after == 1 ? "" : "s");
+    if (!reduction->n_programs_before_overflows && !reduction->n_programs_after_overflows) {
+        fprintf(stderr, " (%.3gx fewer)", (double)reduction->n_programs_before / reduction->n_programs_after);
     }
-    printf("}\n");
+    fprintf(stderr, ", %" PRIu64 " -> %" PRIu64 " options, %d dead rule%s\n", reduction->n_options_before,
+            reduction->n_options_after, reduction->n_dead_rules, reduction->n_dead_rules == 1 ? "" : "s");
 }
 
-/* Function for printing def(R). */
-void print_def(DefiniteProgram *def, int n_programs) {
-    printf("def(R) = {\n");
-    for (int i = 0; i < n_programs; i++) {
-        printf("  ");
-        print_definite_program(def[i]);
-        if (i < n_programs - 1) printf(",\n");
-        else printf("\n");
+/* Function for reporting on stderr how much of def(R) a search under
+ * --limit or --time-budget covered, and why it stopped short, if it did. */
+void print_coverage(const Results *results, const Options *options) {
+    const ModelSet *set = (options->stages & STAGE_CNSD) ? &results->cnsd : &results->out1;
+    if (results->coverage >= 1) {
+        fprintf(stderr, "Search complete: all of def(R) covered\n");
+        return;
     }
-    printf("}\n");
+    if (options->budget.max_models > 0 && set->n_models >= (size_t)options->budget.max_models) {
+        fprintf(stderr, "Search stopped after %zu model%s: ", set->n_models, set->n_models == 1 ? "" : "s");
+    } else {
+        fprintf(stderr, "Search stopped at the time budget with %zu model%s: ", set->n_models, set->n_models == 1 ? "" : "s");
+    }
+    fprintf(stderr, "%.3g%% of def(R) covered", 100 * results->coverage);
+    if (!results->n_def_programs_overflows) {
+        fprintf(stderr, " (about %.0f of %" PRIu64 " programs)", results->coverage * results->n_def_programs,
+                results->n_def_programs);
+    }
+    fprintf(stderr, "\n");
 }
 
-/* Function for printing a set of models. */
-void print_models(const char *label, Atom **models, int *sizes, int n_models) {
-    printf("%s = {\n", label);
-    for (int i = 0; i < n_models; i++) {
-        printf("  {");
-        for (int j = 0; j < sizes[i]; j++) {
-            printf("%c", models[i][j]);
-            if (j < sizes[i] - 1) printf(", ");
+/* Function for computing the requested stages of a run per component of
+ * R, each component being compiled, and reduced with --reduce, on its own.
+ * The number of components, and the overall shrinkage with --reduce, are
+ * reported on stderr. */
+Decomposition solve_components(const KnowledgeBase *kb, const Options *options) {
+    Decomposition decomposition = decompose_rules(kb);
+    STATS_START(compile_start);
+    compile_components(&decomposition);
+    fprintf(stderr, "R splits into %d independent component%s\n", decomposition.n_components,
+            decomposition.n_components == 1 ? "" : "s");
+    if (options->reduce) {
+        ProgramSpaceReduction total = { 1, false, 1, false, 0, 0, 0 };
+        for (int c = 0; c < decomposition.n_components; c++) {
+            Component *component = &decomposition.components[c];
+            ProgramSpaceReduction reduction = reduce_program_space(&component->compiled, component->facts, component->n_facts);
+            total.n_programs_before_overflows |= reduction.n_programs_before_overflows ||
+                __builtin_mul_overflow(total.n_programs_before, reduction.n_programs_before, &total.n_programs_before);
+            total.n_programs_after_overflows |= reduction.n_programs_after_overflows ||
+                __builtin_mul_overflow(total.n_programs_after, reduction.n_programs_after, &total.n_programs_after);
+            total.n_options_before += reduction.n_options_before;
+            total.n_options_after += reduction.n_options_after;
+            total.n_dead_rules += reduction.n_dead_rules;
         }
-        printf("}");
-        if (i < n_models - 1) printf(",\n");
-        else printf("\n");
+        print_reduction(&total);
     }
-    printf("}\n");
+    STATS_STOP(TIMER_COMPILE, compile_start);
+    STATS_START(search_start);
+    compute_component_results(&decomposition, options->stages, options->n_threads);
+    STATS_STOP(TIMER_SEARCH, search_start);
+    return decomposition;
 }
 
-/* Read facts and rules from the user.
- * Each fact is a single lowercase letter.
- * Each rule has a body (AND of atoms) and a head (OR of atoms),
- * and is either imperative (⊢) or permissive (⊣).
- * A rule with no head atoms and ruletype == IMPERATIVE is treated as a 
- * constraint (⊢ ⊥).
- */
-void read_input(Atom **facts, int *n_facts, Rule **rules, int *n_rules) {
-    printf("Number of facts: ");
-    scanf("%d", n_facts);
-    *facts = safe_malloc(*n_facts * sizeof(Atom));
-    printf("Enter facts (single lowercase letters):\n");
-    for (int i = 0; i < *n_facts; i++) {
-        printf("  Fact %d: ", i + 1);
-        scanf(" %c", &(*facts)[i]);
+/* Function for exiting with an error if some defᵣ(r) cannot be enumerated. */
+void exit_if_unenumerable(const KnowledgeBase *kb) {
+    int wide = find_unenumerable_rule(kb->rules, kb->n_rules);
+    if (wide >= 0) {
+        fprintf(stderr, "Rule %d has %d head atoms: defᵣ(r) cannot be enumerated beyond %d head atoms.\n",
+                wide + 1, kb->rules[wide].n_atoms_in_head, MAX_ENUMERABLE_HEAD_ATOMS);
+        exit(EXIT_FAILURE);
     }
-    printf("\nNumber of rules: ");
-    scanf("%d", n_rules);
-    *rules = safe_malloc(*n_rules * sizeof(Rule));
-    for (int i = 0; i < *n_rules; i++) {
-        printf("\n--- Rule %d ---\n", i + 1);
-        
-        /* === Body === */
-        int n_body;
-        printf("  Number of atoms in body: ");
-        scanf("%d", &n_body);
-        Atom *body = safe_malloc(n_body * sizeof(Atom));
-        for (int j = 0; j < n_body; j++) {
-            printf("    Body atom %d: ", j + 1);
-            scanf(" %c", &body[j]);
+}
+
+/* Function for exiting with an error if the memory budget of a run cannot
+ * hold MIN_MODELS_IN_MEMORY models in each of its sets, one per stage and
+ * thread, models being as wide as the vocabulary of the knowledge base. */
+void exit_if_memory_too_small(const KnowledgeBase *kb, const Options *options) {
+    if (options->budget.max_memory == 0) return;
+    int n_words = model_words_for(kb->symbols.n_symbols);
+    bool both_stages = (options->stages & STAGE_CNSD) && (options->stages & STAGE_OUT1);
+    int n_sets = options->n_threads * (both_stages ? 2 : 1);
+    if (models_within_memory(options->budget.max_memory, n_sets, n_words) >= MIN_MODELS_IN_MEMORY) return;
+    size_t needed = (MIN_MODELS_IN_MEMORY * n_sets * model_memory(n_words) + (1 << 20) - 1) >> 20;
+    fprintf(stderr, "--max-memory %zu is too small for %d set%s of %d models of %d atoms: give at least %zu MB.\n",
+            options->budget.max_memory >> 20, n_sets, n_sets == 1 ? "" : "s", MIN_MODELS_IN_MEMORY,
+            kb->symbols.n_symbols, needed);
+    exit(EXIT_FAILURE);
+}
+
+/* Function for printing the cardinalities of the requested stages.
+ * |def(R)| comes in closed form; cnsᵈ(R,A) and out₁(R,A) are only kept in
+ * the deduplication sets of the search, or found by the solver, and never
+ * printed. */
+void run_count(const KnowledgeBase *kb, const Options *options) {
+    exit_if_memory_too_small(kb, options);
+    if (options->stages & STAGE_DEF) {
+        BigCount n_programs = count_def_programs(kb->rules, kb->n_rules);
+        char *digits = bigcount_to_string(&n_programs);
+        printf("|def(R)| = %s\n", digits);
+        free(digits);
+        free_bigcount(&n_programs);
+    }
+    if (!(options->stages & (STAGE_CNSD | STAGE_OUT1))) return;
+    if (options->engine == ENGINE_SOLVER) {
+        STATS_START(search_start);
+        Results results = solve_results(kb, options->stages & ~STAGE_DEF, 0, NULL, NULL);
+        STATS_STOP(TIMER_SEARCH, search_start);
+        if (options->stages & STAGE_CNSD) printf("|cnsᵈ(R,A)| = %zu\n", results.cnsd.n_models);
+        if (options->stages & STAGE_OUT1) printf("|out₁(R,A)| = %zu\n", results.out1.n_models);
+        free_results(&results);
+        return;
+    }
+    exit_if_unenumerable(kb);
+    if (options->components) {
+        Decomposition decomposition = solve_components(kb, options);
+        for (int stage = STAGE_CNSD; stage <= STAGE_OUT1; stage <<= 1) {
+            if (!(options->stages & stage)) continue;
+            BigCount n_models = count_component_models(&decomposition, stage);
+            char *digits = bigcount_to_string(&n_models);
+            printf(stage == STAGE_CNSD ? "|cnsᵈ(R,A)| = %s\n" : "|out₁(R,A)| = %s\n", digits);
+            free(digits);
+            free_bigcount(&n_models);
         }
+        free_decomposition(&decomposition);
+        return;
+    }
+    STATS_START(compile_start);
+    CompiledRules compiled = compile_rules(kb->rules, kb->n_rules, kb->symbols.n_symbols);
+    if (options->reduce) {
+        ProgramSpaceReduction reduction = reduce_program_space(&compiled, kb->facts, kb->n_facts);
+        print_reduction(&reduction);
+    }
+    STATS_STOP(TIMER_COMPILE, compile_start);
+    STATS_START(search_start);
+    bool budgeted = options->budget.max_models > 0 || options->budget.time_budget_ms > 0;
+    Results results = compute_results(&compiled, kb->facts, kb->n_facts, options->stages & ~STAGE_DEF, options->n_threads,
+                                      NULL, NULL, 0, NULL, NULL,
+                                      budgeted || options->budget.max_memory > 0 ? &options->budget : NULL);
+    if (budgeted) print_coverage(&results, options);
+    if (options->engine == ENGINE_CHECK) {
+        Results solved = solve_results(kb, options->stages & ~STAGE_DEF, 0, NULL, NULL);
+        check_solver_results(&results, &solved, options->stages);
+        free_results(&solved);
+    }
+    STATS_STOP(TIMER_SEARCH, search_start);
+    if (options->stages & STAGE_CNSD) printf("|cnsᵈ(R,A)| = %" PRIu64 "\n", count_results_models(&results, STAGE_CNSD));
+    if (options->stages & STAGE_OUT1) printf("|out₁(R,A)| = %" PRIu64 "\n", count_results_models(&results, STAGE_OUT1));
+    free_results(&results);
+    free_compiled_rules(&compiled);
+}
 
-        /* === Head === */
-        int n_head;
-        printf("  Number of atoms in head (0 for constraint): ");
-        scanf("%d", &n_head);
-        Atom *head = NULL;
-        if (n_head > 0) {
-            head = safe_malloc(n_head * sizeof(Atom));
-            for (int j = 0; j < n_head; j++) {
-                printf("    Head atom %d: ", j + 1);
-                scanf(" %c", &head[j]);
-            }
+/* Function for evaluating out₁(R,A) for every fact set A of a query file,
+ * the rules being compiled once for all of them. Queries are read and
+ * evaluated by batches of QUERY_BATCH_SIZE, spread over the threads, and
+ * the result blocks of each batch are printed in the order of the file. */
+void run_queries(const KnowledgeBase *kb, const Options *options) {
+    exit_if_unenumerable(kb);
+    STATS_START(compile_start);
+    CompiledRules compiled = compile_rules(kb->rules, kb->n_rules, kb->symbols.n_symbols);
+    STATS_STOP(TIMER_COMPILE, compile_start);
+    QueryReader reader;
+    open_query_reader(&reader, options->queries_path);
+    Query *queries = safe_malloc(QUERY_BATCH_SIZE * sizeof(Query));
+    ModelWriter output;
+    init_model_writer(&output, stdout, FORMAT_HUMAN, &kb->symbols);
+    int n_queries, n_printed = 0;
+    while (true) {
+        STATS_START(load_start);
+        n_queries = read_queries(&reader, &kb->symbols, kb->facts, kb->n_facts, queries, QUERY_BATCH_SIZE);
+        STATS_STOP(TIMER_LOAD, load_start);
+        if (n_queries == 0) break;
+        STATS_START(search_start);
+        evaluate_queries(&compiled, queries, n_queries, options->n_threads);
+        STATS_STOP(TIMER_SEARCH, search_start);
+        STATS_START(output_start);
+        for (int q = 0; q < n_queries; q++) {
+            print_query(&output, &queries[q], ++n_printed, options->count_only);
+            free_query(&queries[q]);
         }
+        fflush(stdout);
+        STATS_STOP(TIMER_OUTPUT, output_start);
+    }
+    free_model_writer(&output);
+    free(queries);
+    close_query_reader(&reader);
+    free_compiled_rules(&compiled);
+}
 
-        /* === Rule type === */
-        char type;
-        printf("  Rule type (i = ⊢, p = ⊣): ");
-        scanf(" %c", &type);
-        RuleType ruletype = (type == 'i') ? IMPERATIVE : PERMISSIVE;
+/* Function for parsing the atoms of a question of the command line, given
+ * to option, as a fact set. Exits with an error if they are malformed. */
+void parse_question(const char *option, const char *text, const KnowledgeBase *kb, Query *question) {
+    KbParser parser = { option, text, text, text + strlen(text), 1, text, "" };
+    if (!parse_query(&parser, &kb->symbols, kb->facts, 0, question)) {
+        fprintf(stderr, "%s\n", parser.error);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* Function for printing the answer to a question, with the model found, if any. */
+void print_answer(const KnowledgeBase *kb, bool yes, const Model *model, Atom *atoms) {
+    printf("%s", yes ? "yes" : "no");
+    if (model) {
+        printf(", ");
+        fprint_model(stdout, &kb->symbols, model, NULL, 0, atoms);
+    }
+    printf("\n");
+}
+
+/* Function for answering the questions of the command line about
+ * out₁(R,A) with a single solver, never enumerating out₁(R,A): whether
+ * each atom of --credulous is in some model, the search stopping at the
+ * first witness; whether each atom of --skeptical is in every model, the
+ * search stopping at the first counterexample; whether the set of
+ * --member is a model; and last, since their search excludes the
+ * supersets of the models found, the ⊆-minimal models. Atoms unknown to R
+ * are in no model. */
+void run_questions(const KnowledgeBase *kb, const Options *options) {
+    int n_atoms = kb->symbols.n_symbols;
+    STATS_START(search_start);
+    Solver solver = new_solver(kb, STAGE_OUT1);
+    Model model = new_model(model_words_for(n_atoms));
+    Atom *unfounded = safe_malloc((n_atoms > 0 ? n_atoms : 1) * sizeof(Atom));
+    Atom *atoms = safe_malloc(model.n_words * MODEL_WORD_BITS * sizeof(Atom));
+    Literal *assumptions = safe_malloc((n_atoms > 0 ? n_atoms : 1) * sizeof(Literal));
+    Query question;
+    if (options->credulous) {
+        parse_question("--credulous", options->credulous, kb, &question);
+        for (int i = 0; i < question.n_facts; i++) {
+            assumptions[0] = 2 * question.facts[i];
+            bool found = find_founded_model(&solver, kb, assumptions, 1, unfounded, &model);
+            printf("%s ∈ some model of out₁(R,A): ", atom_name(&kb->symbols, question.facts[i]));
+            print_answer(kb, found, found ? &model : NULL, atoms);
+        }
+        for (int e = 0; e < question.n_extras; e++) {
+            printf("%s ∈ some model of out₁(R,A): ", question.extras[e]);
+            print_answer(kb, false, NULL, atoms);
+        }
+        free_query_atoms(&question);
+    }
+    if (options->skeptical) {
+        parse_question("--skeptical", options->skeptical, kb, &question);
+        for (int i = 0; i < question.n_facts; i++) {
+            assumptions[0] = 2 * question.facts[i] + 1;
+            bool found = find_founded_model(&solver, kb, assumptions, 1, unfounded, &model);
+            printf("%s ∈ every model of out₁(R,A): ", atom_name(&kb->symbols, question.facts[i]));
+            print_answer(kb, !found, found ? &model : NULL, atoms);
+        }
+        for (int e = 0; e < question.n_extras; e++) {
+            bool found = find_founded_model(&solver, kb, NULL, 0, unfounded, &model);
+            printf("%s ∈ every model of out₁(R,A): ", question.extras[e]);
+            print_answer(kb, !found, found ? &model : NULL, atoms);
+        }
+        free_query_atoms(&question);
+    }
+    if (options->member) {
+        parse_question("--member", options->member, kb, &question);
+        model_set_atoms(&model, question.facts, question.n_facts);
+        for (Atom a = 0; a < n_atoms; a++) {
+            assumptions[a] = 2 * a + !model_contains(&model, a);
+        }
+        Model member = new_model(model.n_words);
+        bool found = question.n_extras == 0 && find_founded_model(&solver, kb, assumptions, n_atoms, unfounded, &member);
+        fprint_model(stdout, &kb->symbols, &model, question.extras, question.n_extras, atoms);
+        printf(" ∈ out₁(R,A): ");
+        print_answer(kb, found, NULL, atoms);
+        free_model(&member);
+        free_query_atoms(&question);
+    }
+    if (options->minimal) {
+        ModelWriter output;
+        init_model_writer(&output, stdout, options->format, &kb->symbols);
+        fflush(stdout);
+        if (options->format == FORMAT_HUMAN) {
+            output.n_models = 0;
+            writer_puts(&output.writer, "min(out₁(R,A)) = {\n");
+        } else {
+            begin_model_set(&output, STAGE_OUT1);
+        }
+        ModelSet minimal = find_minimal_models(&solver, kb, stream_model, &output);
+        end_model_set(&output, 0);
+        free_model_writer(&output);
+        free_model_set(&minimal);
+    }
+    fflush(stdout);
+    STATS_STOP(TIMER_SEARCH, search_start);
+    free(assumptions);
+    free(atoms);
+    free(unfounded);
+    free_model(&model);
+    free_solver(&solver);
+}
+
+/* Function for parsing an update of a knowledge base: + or -, for adding
+ * or retracting, then a single fact or rule in the syntax of knowledge
+ * base files, read into change over the symbols of kb, new atoms being
+ * interned there. Returns false on a syntax error, described in
+ * parser->error, leaving nothing allocated in change. */
+bool parse_update(KbParser *parser, KnowledgeBase *kb, bool *insert, KnowledgeBase *change) {
+    skip_blanks(parser);
+    if (parser->cursor == parser->end || (*parser->cursor != '+' && *parser->cursor != '-')) {
+        return parse_error(parser, "expected '+' or '-'");
+    }
+    *insert = *parser->cursor++ == '+';
+    change->symbols = kb->symbols;
+    bool parsed = parse_kb(parser, change);
+    kb->symbols = change->symbols;
+    if (parsed && change->n_facts + change->n_rules != 1) {
+        parsed = parse_error(parser, "expected a single fact or rule");
+    }
+    if (!parsed) {
+        free_rules(change->rules, change->n_rules);
+        free(change->facts);
+    }
+    return parsed;
+}
+
+/* Function for printing the models an update added to out₁(R,A) or
+ * removed from it, under a label. */
+void print_delta(ModelWriter *output, const char *label, const ModelSet *set) {
+    output->n_models = 0;
+    writer_puts(&output->writer, label);
+    write_model_set(output, set);
+    end_model_set(output, 0);
+}
+
+/* Function for printing out₁(R,A), then maintaining it through the updates
+ * of a file, one per line, and printing what each update changes: the
+ * models added and removed, or with --count only their numbers. Atoms new
+ * to the knowledge base are numbered in, in alphabetical order, the
+ * models being renumbered accordingly. */
+void run_updates(KnowledgeBase *kb, const Options *options) {
+    STATS_START(search_start);
+    MaintainedOut1 maintained;
+    init_maintained_out1(&maintained, kb);
+    STATS_STOP(TIMER_SEARCH, search_start);
+    ModelWriter output;
+    init_model_writer(&output, stdout, FORMAT_HUMAN, &kb->symbols);
+    if (options->count_only) {
+        printf("|out₁(R,A)| = %zu\n", maintained.out1.n_models);
+    } else {
+        print_separator();
+        print_models(&output, STAGE_OUT1, &maintained.out1, NULL, 0);
+    }
+    fflush(stdout);
+    QueryReader reader;
+    open_query_reader(&reader, options->updates_path);
+    ssize_t length;
+    int n_updates = 0;
+    while ((length = getline(&reader.buffer, &reader.capacity, reader.file)) >= 0) {
+        reader.line++;
+        KbParser parser = { reader.path, reader.buffer, reader.buffer, reader.buffer + length, reader.line, reader.buffer, "" };
+        skip_blanks(&parser);
+        if (parser.cursor == parser.end) continue;
+        const char *statement = parser.cursor;
+        STATS_START(load_start);
+        KnowledgeBase change;
+        bool insert;
+        int n_symbols = kb->symbols.n_symbols;
+        if (!parse_update(&parser, kb, &insert, &change)) {
+            fprintf(stderr, "%s\n", parser.error);
+            exit(EXIT_FAILURE);
+        }
+        if (kb->symbols.n_symbols > n_symbols) {
+            Atom *renumber = safe_malloc(kb->symbols.n_symbols * sizeof(Atom));
+            sort_symbol_table(&kb->symbols, renumber);
+            renumber_atoms(kb, renumber);
+            renumber_atoms(&change, renumber);
+            renumber_maintained_models(&maintained, renumber);
+            free(renumber);
+            free_model_writer(&output);
+            init_model_writer(&output, stdout, FORMAT_HUMAN, &kb->symbols);
+        }
+        STATS_STOP(TIMER_LOAD, load_start);
+        STATS_START(update_start);
+        bool updated = change.n_facts == 1 ? update_fact(&maintained, change.facts[0], insert)
+                                           : update_rule(&maintained, &change.rules[0], insert);
+        STATS_STOP(TIMER_SEARCH, update_start);
+        if (!updated) {
+            fprintf(stderr, "%s:%d: no such %s to retract\n", reader.path, reader.line, change.n_facts == 1 ? "fact" : "rule");
+            exit(EXIT_FAILURE);
+        }
+        if (change.n_rules == 1 && insert) free(change.rules);
+        else free_rules(change.rules, change.n_rules);
+        free(change.facts);
         
-        /* === Store rule === */
-        Rule r;
-        r.n_atoms_in_body = n_body;
-        r.body = safe_malloc(n_body * sizeof(Atom));
-        for (int j = 0; j < n_body; j++) r.body[j] = body[j];
-        if (n_head == 0) {
-
-            /* Encode constraint as head = {'/'} and n_atoms_in_head = 1 */
-            r.n_atoms_in_head = 1;
-            r.head = safe_malloc(sizeof(Atom));
-            r.head[0] = '/';
+        /* Print the update, without its line break, and what it changed. */
+        STATS_START(output_start);
+        int n_statement = (int)(reader.buffer + length - statement);
+        while (n_statement > 0 && isspace((unsigned char)statement[n_statement - 1])) n_statement--;
+        if (options->count_only) {
+            printf("Update %d: %.*s |out₁(R,A)| = %zu (+%zu, -%zu)\n", ++n_updates, n_statement, statement,
+                   maintained.out1.n_models, maintained.added.n_models, maintained.removed.n_models);
         } else {
-            r.n_atoms_in_head = n_head;
-            r.head = safe_malloc(n_head * sizeof(Atom));
-            for (int j = 0; j < n_head; j++) r.head[j] = head[j];
+            print_separator();
+            printf("Update %d: %.*s\n", ++n_updates, n_statement, statement);
+            print_delta(&output, "out₁(R,A) += {\n", &maintained.added);
+            print_delta(&output, "out₁(R,A) -= {\n", &maintained.removed);
+            printf("|out₁(R,A)| = %zu\n", maintained.out1.n_models);
         }
-        r.ruletype = ruletype;
-        (*rules)[i] = r;
-        free(body);
-        if (head) free(head);
+        fflush(stdout);
+        STATS_STOP(TIMER_OUTPUT, output_start);
     }
+    close_query_reader(&reader);
+    free_model_writer(&output);
+    free_maintained_out1(&maintained);
 }
 
-/* * * * * * * * * * * * * * * * * * * Session * * * * * * * * * * * * * * * * * * * * */
+#ifdef KL1_STATS
+/* Function for printing the counters and timers of all threads as JSON on
+ * stderr. */
+void print_stats(void) {
+    flush_stats();
+    fprintf(stderr, "{\"counters\": {\"programs_enumerated\": %" PRIu64 ", \"fixpoint_iterations\": %" PRIu64
+            ", \"clause_evaluations\": %" PRIu64 ", \"membership_tests\": %" PRIu64 ", \"dedup_comparisons\": %" PRIu64
+            ", \"duplicates_found\": %" PRIu64 ", \"models_rejected\": %" PRIu64 ", \"subtrees_pruned\": %" PRIu64
+            ", \"bytes_allocated\": %" PRIu64 ", \"solver_decisions\": %" PRIu64 ", \"solver_conflicts\": %" PRIu64
+            ", \"loop_formulas\": %" PRIu64 ", \"models_spilled\": %" PRIu64 "}, ",
+            total_stats.programs_enumerated, total_stats.fixpoint_iterations, total_stats.clause_evaluations,
+            total_stats.membership_tests, total_stats.dedup_comparisons, total_stats.duplicates_found,
+            total_stats.models_rejected, total_stats.subtrees_pruned, total_stats.bytes_allocated,
+            total_stats.solver_decisions, total_stats.solver_conflicts, total_stats.loop_formulas, total_stats.models_spilled);
+    fprintf(stderr, "\"seconds\": {\"load\": %.6f, \"compile\": %.6f, \"search\": %.6f, \"output\": %.6f}}\n",
+            total_stats.seconds[TIMER_LOAD], total_stats.seconds[TIMER_COMPILE], total_stats.seconds[TIMER_SEARCH],
+            total_stats.seconds[TIMER_OUTPUT]);
+}
+#endif
 
-/* Utility function to print a separator line for output sections. */
-void print_separator(void) {
-    printf("===========================================================\n");
+/* Function for ending a run with the given exit status, printing the
+ * --stats report first if it was requested. */
+int end_run(const Options *options, int status) {
+#ifdef KL1_STATS
+    if (options->stats) {
+        fflush(stdout);
+        print_stats();
+    }
+#else
+    (void)options;
+#endif
+    return status;
 }
 
-/* Function to clear screen and display all input facts and rules. */
-void print_knowledge_base(const KnowledgeBase *kb) {
-    printf("\x1b[3J\x1b[H\x1b[2J");
-    print_atoms(kb->facts, kb->n_facts);
-    printf("R:\n");
-    for (int i = 0; i < kb->n_rules; i++) {
-        print_rule(kb->rules[i]);
-        printf("\n");
+/* Visitor skipping the programs of def(R), to time their enumeration alone. */
+bool skip_program(DefiniteProgram program, const int *choice, void *context) {
+    (void)program;
+    (void)choice;
+    (void)context;
+    return true;
+}
+
+/* Visitor computing the least model of a program of def(R) from scratch,
+ * with context pointing to the KnowledgeBase giving the facts. */
+bool compute_least_model(DefiniteProgram program, const int *choice, void *context) {
+    const KnowledgeBase *kb = context;
+    (void)choice;
+    Model m = least_model(program, kb->facts, kb->n_facts, kb->symbols.n_symbols);
+    free_model(&m);
+    return true;
+}
+
+/* Function for printing a string as a JSON string. */
+void print_json_string(const char *string) {
+    putchar('"');
+    for (; *string; string++) {
+        unsigned char c = *string;
+        if (c == '"' || c == '\\') printf("\\%c", c);
+        else if (c < 0x20) printf("\\u%04x", c);
+        else putchar(c);
     }
+    putchar('"');
 }
 
-/* Free an array of DefiniteProgram structures and their contents. */
-void free_definite_programs(DefiniteProgram *programs, int count) {
-    for (int i = 0; i < count; i++) {
-        for (int j = 0; j < programs[i].n_clauses; j++) {
-            free(programs[i].clauses[j].body);
+/* Function for printing the timing of a benchmark phase as a JSON object,
+ * with the throughput of its items when it has any. */
+void print_bench_phase(const char *phase, double seconds, const char *items, uint64_t n_items) {
+    printf("{\"phase\": \"%s\", \"seconds\": %.6f", phase, seconds);
+    if (items) {
+        printf(", \"%s\": %" PRIu64 ", \"%s_per_second\": %.1f", items, n_items, items,
+               seconds > 0 ? n_items / seconds : 0.0);
+    }
+    printf("}");
+}
+
+/* Function for benchmarking a knowledge base, read from --input or
+ * generated from --generate: every phase is timed on its own, def(R)
+ * being enumerated alone, then with a least model computed from scratch
+ * for every program, then searched for cnsᵈ(R,A) and for out₁(R,A) on
+ * --threads threads. The timings, the throughputs and the peak resident
+ * set size are printed as one line of JSON. */
+int run_bench(const Options *options) {
+    const char *path = options->generate ? "generated" : options->input_path;
+    char *text;
+    size_t length;
+    if (options->generate) {
+        FILE *stream = open_memstream(&text, &length);
+        generate_kb(stream, &options->generator);
+        fclose(stream);
+    } else if (!(text = read_file(path, &length))) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    
+    /* Loading: parsing, interning and numbering atoms. */
+    char error[256];
+    KnowledgeBase kb;
+    double start = now_seconds();
+    if (!load_kb_text(path, text, length, &kb, error, sizeof(error))) {
+        fprintf(stderr, "%s\n", error);
+        exit(EXIT_FAILURE);
+    }
+    double load_seconds = now_seconds() - start;
+    free(text);
+    exit_if_unenumerable(&kb);
+    
+    /* Compiling: defᵣ(r) for every rule and the watch lists. */
+    start = now_seconds();
+    CompiledRules compiled = compile_rules(kb.rules, kb.n_rules, kb.symbols.n_symbols);
+    double compile_seconds = now_seconds() - start;
+    if (compiled.n_programs_overflows) {
+        fprintf(stderr, "def(R) has more than 2^64 programs: it cannot be benchmarked.\n");
+        exit(EXIT_FAILURE);
+    }
+    start = now_seconds();
+    uint64_t n_programs = defR(&compiled, skip_program, NULL);
+    double def_seconds = now_seconds() - start;
+    start = now_seconds();
+    uint64_t n_fixpoints = defR(&compiled, compute_least_model, &kb);
+    double fixpoint_seconds = now_seconds() - start;
+    start = now_seconds();
+    Results cnsd = cns_star(&compiled, kb.facts, kb.n_facts, options->n_threads);
+    double cnsd_seconds = now_seconds() - start;
+    start = now_seconds();
+    Results out1 = out(&compiled, kb.facts, kb.n_facts, options->n_threads);
+    double out1_seconds = now_seconds() - start;
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    
+    printf("{\"input\": ");
+    print_json_string(path);
+    if (options->generate) {
+        const GeneratorSpec *spec = &options->generator;
+        printf(", \"generator\": {\"atoms\": %d, \"rules\": %d, \"facts\": %d, \"body\": %d, \"head\": %d, "
+               "\"permissive\": %g, \"constraints\": %g, \"chain\": %d, \"seed\": %" PRIu64 "}",
+               spec->n_atoms, spec->n_rules, spec->n_facts, spec->body_width, spec->head_width, spec->permissive,
+               spec->constraints, spec->chain_depth, spec->seed);
+    }
+    printf(", \"threads\": %d, \"atoms\": %d, \"facts\": %d, \"rules\": %d, \"programs\": %" PRIu64 ", "
+           "\"cnsd_models\": %zu, \"out1_models\": %zu, \"phases\": [",
+           options->n_threads, kb.symbols.n_symbols, kb.n_facts, kb.n_rules, n_programs, cnsd.cnsd.n_models,
+           out1.out1.n_models);
+    print_bench_phase("load", load_seconds, NULL, 0);
+    printf(", ");
+    print_bench_phase("compile", compile_seconds, NULL, 0);
+    printf(", ");
+    print_bench_phase("defR", def_seconds, "programs", n_programs);
+    printf(", ");
+    print_bench_phase("least_model", fixpoint_seconds, "fixpoints", n_fixpoints);
+    printf(", ");
+    print_bench_phase("cns_star", cnsd_seconds, "programs", n_programs);
+    printf(", ");
+    print_bench_phase("out", out1_seconds, "programs", n_programs);
+    printf("], \"peak_rss_kb\": %ld}\n", usage.ru_maxrss);
+    free_results(&cnsd);
+    free_results(&out1);
+    free_compiled_rules(&compiled);
+    free_knowledge_base(&kb);
+    return EXIT_SUCCESS;
+}
+
+/* * * * * * * * * * * * * * * * * * * Server * * * * * * * * * * * * * * * * * * * * */
+
+/* Function for loading a knowledge base to be served and compiling its
+ * rules. Returns NULL, with a message in error, if the file cannot be
+ * loaded or some defᵣ(r) cannot be enumerated. */
+ServedKnowledgeBase *load_served_kb(const char *path, char *error, size_t error_size) {
+    ServedKnowledgeBase *served = safe_malloc(sizeof(ServedKnowledgeBase));
+    STATS_START(load_start);
+    if (!load_kb_file(path, &served->kb, error, error_size)) {
+        free(served);
+        return NULL;
+    }
+    STATS_STOP(TIMER_LOAD, load_start);
+    int wide = find_unenumerable_rule(served->kb.rules, served->kb.n_rules);
+    if (wide >= 0) {
+        snprintf(error, error_size, "%s: rule %d has %d head atoms: defᵣ(r) cannot be enumerated beyond %d head atoms",
+                 path, wide + 1, served->kb.rules[wide].n_atoms_in_head, MAX_ENUMERABLE_HEAD_ATOMS);
+        free_knowledge_base(&served->kb);
+        free(served);
+        return NULL;
+    }
+    STATS_START(compile_start);
+    served->compiled = compile_rules(served->kb.rules, served->kb.n_rules, served->kb.symbols.n_symbols);
+    STATS_STOP(TIMER_COMPILE, compile_start);
+    served->n_users = 1;
+    return served;
+}
+
+/* Function for taking a reference to the current knowledge base. */
+ServedKnowledgeBase *acquire_served_kb(Server *server) {
+    pthread_mutex_lock(&server->lock);
+    ServedKnowledgeBase *served = server->current;
+    served->n_users++;
+    pthread_mutex_unlock(&server->lock);
+    return served;
+}
+
+/* Function for dropping a reference to a knowledge base, freeing it if it
+ * was the last one. */
+void release_served_kb(Server *server, ServedKnowledgeBase *served) {
+    pthread_mutex_lock(&server->lock);
+    bool last = --served->n_users == 0;
+    pthread_mutex_unlock(&server->lock);
+    if (last) {
+        free_compiled_rules(&served->compiled);
+        free_knowledge_base(&served->kb);
+        free(served);
+    }
+}
+
+/* Function for making a worker serve the current knowledge base: a search
+ * over its rules is set up when the worker has none yet, or when the
+ * knowledge base was reloaded since. */
+void attach_worker(ServerWorker *worker) {
+    ServedKnowledgeBase *served = acquire_served_kb(worker->server);
+    if (served == worker->served) {
+        release_served_kb(worker->server, served);
+        return;
+    }
+    if (worker->served) {
+        free_def_search(&worker->search);
+        release_served_kb(worker->server, worker->served);
+    }
+    worker->served = served;
+    init_def_search(&worker->search, &served->compiled, NULL, 0, true);
+}
+
+/* Function for releasing the knowledge base served by a worker, if any. */
+void detach_worker(ServerWorker *worker) {
+    if (!worker->served) return;
+    free_def_search(&worker->search);
+    release_served_kb(worker->server, worker->served);
+    worker->served = NULL;
+}
+
+/* Function for answering an out1 or cnsd request: the fact set, in the
+ * syntax of query files, is added to the facts of the knowledge base and
+ * the models of the stage are sent, one per line. */
+void serve_models(ServerWorker *worker, Stage stage, const char *request, const char *facts, const char *end, int line,
+                  FILE *out) {
+    attach_worker(worker);
+    const KnowledgeBase *kb = &worker->served->kb;
+    KbParser parser = { "request", request, facts, end, line, request, "" };
+    Query query;
+    if (!parse_query(&parser, &kb->symbols, kb->facts, kb->n_facts, &query)) {
+        fprintf(out, "error %s\n", parser.error);
+        return;
+    }
+    STATS_START(search_start);
+    ModelSet models = rerun_def_search(&worker->search, query.facts, query.n_facts, stage);
+    STATS_STOP(TIMER_SEARCH, search_start);
+    Atom *atoms = safe_malloc(models.n_words * MODEL_WORD_BITS * sizeof(Atom) + 1);
+    fprintf(out, "ok %zu\n", models.n_models);
+    for (size_t i = 0; i < models.n_models; i++) {
+        Model m = model_set_at(&models, i);
+        fprint_model(out, &kb->symbols, &m, query.extras, query.n_extras, atoms);
+        fprintf(out, "\n");
+    }
+    free(atoms);
+    free_model_set(&models);
+    free_query_atoms(&query);
+}
+
+/* Function for answering a reload request: the knowledge base is loaded
+ * from path, or from the file it was last loaded from, and replaces the
+ * current one for the requests that follow. Requests being answered with
+ * the previous one complete with it. */
+void serve_reload(Server *server, const char *path, FILE *out) {
+    pthread_mutex_lock(&server->lock);
+    char *kb_path = strdup(*path ? path : server->kb_path);
+    pthread_mutex_unlock(&server->lock);
+    char error[256];
+    ServedKnowledgeBase *loaded = load_served_kb(kb_path, error, sizeof(error));
+    if (!loaded) {
+        fprintf(out, "error %s\n", error);
+        free(kb_path);
+        return;
+    }
+    fprintf(out, "ok 1\n%s: %d facts, %d rules, %d atoms\n", kb_path, loaded->kb.n_facts, loaded->kb.n_rules,
+            loaded->kb.symbols.n_symbols);
+    pthread_mutex_lock(&server->lock);
+    ServedKnowledgeBase *previous = server->current;
+    server->current = loaded;
+    free(server->kb_path);
+    server->kb_path = kb_path;
+    pthread_mutex_unlock(&server->lock);
+    release_served_kb(server, previous);
+}
+
+/* Function for stopping the server: no more clients are accepted, and the
+ * clients being served get no more requests. */
+void stop_server(Server *server) {
+    pthread_mutex_lock(&server->lock);
+    server->stopping = true;
+    shutdown(server->listen_fd, SHUT_RDWR);
+    for (int i = 0; i < server->n_workers; i++) {
+        if (server->client_fds[i] >= 0) shutdown(server->client_fds[i], SHUT_RD);
+    }
+    pthread_cond_broadcast(&server->queued);
+    pthread_cond_broadcast(&server->dequeued);
+    pthread_mutex_unlock(&server->lock);
+}
+
+/* Function for answering one request line of a client. Every request gets
+ * a response made of a line "ok N" followed by N lines, or of a single
+ * line "error MESSAGE". Blank lines and comments get no response.
+ * Returns false once the connection is to be closed. */
+bool serve_request(ServerWorker *worker, char *request, size_t length, int line, FILE *out) {
+    char *end = request + length;
+    while (end > request && isspace((unsigned char)end[-1])) end--;
+    *end = '\0';
+    char *command = request;
+    while (isspace((unsigned char)*command)) command++;
+    if (*command == '\0' || *command == '%') return true;
+    size_t command_length = strcspn(command, " \t");
+    char *argument = command + command_length;
+    while (isspace((unsigned char)*argument)) argument++;
+    if (command_length == 4 && strncmp(command, "out1", 4) == 0) {
+        serve_models(worker, STAGE_OUT1, request, argument, end, line, out);
+    } else if (command_length == 4 && strncmp(command, "cnsd", 4) == 0) {
+        serve_models(worker, STAGE_CNSD, request, argument, end, line, out);
+    } else if (command_length == 6 && strncmp(command, "reload", 6) == 0) {
+        serve_reload(worker->server, argument, out);
+    } else if (command_length == 4 && strncmp(command, "quit", 4) == 0) {
+        fprintf(out, "ok 0\n");
+        return false;
+    } else if (command_length == 8 && strncmp(command, "shutdown", 8) == 0) {
+        fprintf(out, "ok 0\n");
+        fflush(out);
+        stop_server(worker->server);
+        return false;
+    } else {
+        fprintf(out, "error unknown request '%.*s'\n", (int)command_length, command);
+    }
+    return true;
+}
+
+/* Function for answering the requests of a client until it disconnects or
+ * quits. */
+void serve_client(ServerWorker *worker, int fd) {
+    int out_fd = dup(fd);
+    FILE *in = fdopen(fd, "r");
+    FILE *out = out_fd >= 0 ? fdopen(out_fd, "w") : NULL;
+    if (!in || !out) {
+        if (out) fclose(out);
+        else if (out_fd >= 0) close(out_fd);
+        if (in) fclose(in);
+        else close(fd);
+        return;
+    }
+    char *request = NULL;
+    size_t capacity = 0;
+    ssize_t length;
+    int line = 0;
+    while ((length = getline(&request, &capacity, in)) >= 0) {
+        bool open = serve_request(worker, request, length, ++line, out);
+        if (fflush(out) != 0 || !open) break;
+    }
+    free(request);
+    detach_worker(worker);
+    STATS_FLUSH();
+    
+    /* The socket is forgotten before it is closed, so that stop_server
+     * cannot shut down a socket reusing its descriptor. */
+    pthread_mutex_lock(&worker->server->lock);
+    worker->server->client_fds[worker->index] = -1;
+    pthread_mutex_unlock(&worker->server->lock);
+    fclose(out);
+    fclose(in);
+}
+
+/* Thread body of a server worker: take the next accepted client, serve it,
+ * and start again until the server stops. */
+void *run_server_worker(void *arg) {
+    ServerWorker *worker = arg;
+    Server *server = worker->server;
+    while (true) {
+        pthread_mutex_lock(&server->lock);
+        while (server->n_queued == 0 && !server->stopping) pthread_cond_wait(&server->queued, &server->lock);
+        if (server->stopping) {
+            pthread_mutex_unlock(&server->lock);
+            return NULL;
         }
-        free(programs[i].clauses);
+        int fd = server->queue[server->first_queued];
+        server->first_queued = (server->first_queued + 1) % SERVER_QUEUE_SIZE;
+        server->n_queued--;
+        server->client_fds[worker->index] = fd;
+        pthread_cond_signal(&server->dequeued);
+        pthread_mutex_unlock(&server->lock);
+        serve_client(worker, fd);
     }
-    free(programs);
 }
 
-/* Free an array of models (Atom arrays) and their sizes. */
-void free_models(Atom **models, int *sizes, int count) {
-    for (int i = 0; i < count; i++) {
-        free(models[i]);
+/* Function for opening the listening socket of the server. A socket left
+ * behind by a server that is no longer running is replaced. */
+int open_server_socket(const char *path) {
+    struct sockaddr_un address;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "%s: socket path too long\n", path);
+        exit(EXIT_FAILURE);
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        exit(EXIT_FAILURE);
+    }
+    int bound = bind(fd, (struct sockaddr *)&address, sizeof(address));
+    if (bound != 0 && errno == EADDRINUSE) {
+        
+        /* Replace the socket if no server answers on it. */
+        int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (probe >= 0 && connect(probe, (struct sockaddr *)&address, sizeof(address)) != 0 && errno == ECONNREFUSED) {
+            unlink(path);
+            bound = bind(fd, (struct sockaddr *)&address, sizeof(address));
+        } else {
+            errno = EADDRINUSE;
+        }
+        if (probe >= 0) close(probe);
+    }
+    if (bound != 0 || listen(fd, SOMAXCONN) != 0) {
+        perror(path);
+        exit(EXIT_FAILURE);
     }
-    free(models);
-    free(sizes);
+    return fd;
 }
 
-/* Free an array of Rule structures and their allocated fields. */
-void free_rules(Rule *rules, int count) {
-    for (int i = 0; i < count; i++) {
-        free(rules[i].body);
-        free(rules[i].head);
+/* Function for running the server: the knowledge base of --input is loaded
+ * and compiled once, then clients connecting to the socket are served by
+ * --threads workers until one of them sends shutdown. */
+void run_server(const Options *options) {
+    Server server;
+    char error[256];
+    server.socket_path = options->serve_path;
+    server.kb_path = strdup(options->input_path);
+    server.current = load_served_kb(options->input_path, error, sizeof(error));
+    if (!server.current) {
+        fprintf(stderr, "%s\n", error);
+        exit(EXIT_FAILURE);
     }
-    free(rules);
+    
+    /* Clients closing their connection early must not kill the server. */
+    signal(SIGPIPE, SIG_IGN);
+    server.listen_fd = open_server_socket(options->serve_path);
+    pthread_mutex_init(&server.lock, NULL);
+    pthread_cond_init(&server.queued, NULL);
+    pthread_cond_init(&server.dequeued, NULL);
+    server.queue = safe_malloc(SERVER_QUEUE_SIZE * sizeof(int));
+    server.first_queued = 0;
+    server.n_queued = 0;
+    server.n_workers = options->n_threads;
+    server.client_fds = safe_malloc(server.n_workers * sizeof(int));
+    server.workers = safe_malloc(server.n_workers * sizeof(ServerWorker));
+    server.stopping = false;
+    for (int i = 0; i < server.n_workers; i++) {
+        server.client_fds[i] = -1;
+        server.workers[i].server = &server;
+        server.workers[i].index = i;
+        server.workers[i].served = NULL;
+        if (pthread_create(&server.workers[i].thread, NULL, run_server_worker, &server.workers[i]) != 0) {
+            perror("Thread creation failed!");
+            exit(EXIT_FAILURE);
+        }
+    }
+    fprintf(stderr, "Serving %s on %s with %d thread%s\n", options->input_path, options->serve_path, server.n_workers,
+            server.n_workers == 1 ? "" : "s");
+    
+    /* Accept clients and queue them for the workers. */
+    while (true) {
+        int fd = accept(server.listen_fd, NULL, NULL);
+        pthread_mutex_lock(&server.lock);
+        while (fd >= 0 && server.n_queued == SERVER_QUEUE_SIZE && !server.stopping) {
+            pthread_cond_wait(&server.dequeued, &server.lock);
+        }
+        bool stopping = server.stopping;
+        if (fd >= 0 && !stopping) {
+            server.queue[(server.first_queued + server.n_queued++) % SERVER_QUEUE_SIZE] = fd;
+            pthread_cond_signal(&server.queued);
+        }
+        pthread_mutex_unlock(&server.lock);
+        if (stopping) {
+            if (fd >= 0) close(fd);
+            break;
+        }
+        if (fd < 0 && errno != EINTR && errno != ECONNABORTED) {
+            perror("accept");
+            stop_server(&server);
+            break;
+        }
+    }
+    for (int i = 0; i < server.n_workers; i++) {
+        pthread_join(server.workers[i].thread, NULL);
+    }
+    
+    /* Clients still waiting in the queue are dropped. */
+    for (int i = 0; i < server.n_queued; i++) {
+        close(server.queue[(server.first_queued + i) % SERVER_QUEUE_SIZE]);
+    }
+    close(server.listen_fd);
+    unlink(options->serve_path);
+    release_served_kb(&server, server.current);
+    pthread_cond_destroy(&server.queued);
+    pthread_cond_destroy(&server.dequeued);
+    pthread_mutex_destroy(&server.lock);
+    free(server.queue);
+    free(server.client_fds);
+    free(server.workers);
+    free(server.kb_path);
 }
 
-/* Free all memory associated with a KnowledgeBase (facts and rules). */
-void free_knowledge_base(KnowledgeBase *kb) {
-    free_rules(kb->rules, kb->n_rules);
-    free(kb->facts);
+/* Function for connecting to the socket of a server.
+ * Returns -1, with errno set, on failure. */
+int connect_to_server(const char *path) {
+    struct sockaddr_un address;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+/* Thread body of a client connection: send the requests one at a time,
+ * reading every response in full before the next request, and keep the
+ * responses in memory. */
+void *run_client_connection(void *arg) {
+    ClientConnection *connection = arg;
+    FILE *output = open_memstream(&connection->output, &connection->output_size);
+    int fd = connect_to_server(connection->socket_path);
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s\n", connection->socket_path, strerror(errno));
+        connection->failed = true;
+        fclose(output);
+        return NULL;
+    }
+    int out_fd = dup(fd);
+    FILE *in = fdopen(fd, "r");
+    FILE *out = fdopen(out_fd, "w");
+    char *line = NULL;
+    size_t capacity = 0;
+    for (int r = connection->first; r < connection->first + connection->n_requests && !connection->failed; r++) {
+        fprintf(out, "%s\n", connection->requests[r]);
+        int n_lines = 0;
+        if (fflush(out) != 0 || getline(&line, &capacity, in) < 0) {
+            connection->failed = true;
+            break;
+        }
+        fputs(line, output);
+        if (sscanf(line, "ok %d", &n_lines) != 1) n_lines = 0;
+        for (int i = 0; i < n_lines; i++) {
+            if (getline(&line, &capacity, in) < 0) {
+                connection->failed = true;
+                break;
+            }
+            fputs(line, output);
+        }
+    }
+    if (connection->failed) fprintf(stderr, "%s: connection closed by the server\n", connection->socket_path);
+    free(line);
+    fclose(in);
+    fclose(out);
+    fclose(output);
+    return NULL;
+}
+
+/* Function for running the client: the requests of --queries (standard
+ * input by default), one per line, are sent to the server over --threads
+ * connections, each sending a contiguous share of them. Responses are
+ * printed in the order of the requests, and the throughput on stderr, so
+ * that the client doubles as a benchmark driver. */
+int run_client(const Options *options) {
+    QueryReader reader;
+    open_query_reader(&reader, options->queries_path ? options->queries_path : "-");
+    int n_requests = 0, capacity = 16;
+    char **requests = safe_malloc(capacity * sizeof(char *));
+    ssize_t length;
+    while ((length = getline(&reader.buffer, &reader.capacity, reader.file)) >= 0) {
+        while (length > 0 && isspace((unsigned char)reader.buffer[length - 1])) reader.buffer[--length] = '\0';
+        size_t start = strspn(reader.buffer, " \t");
+        if (reader.buffer[start] == '\0' || reader.buffer[start] == '%') continue;
+        if (n_requests == capacity) {
+            capacity *= 2;
+            requests = safe_realloc(requests, capacity * sizeof(char *));
+        }
+        requests[n_requests++] = strdup(reader.buffer + start);
+    }
+    close_query_reader(&reader);
+    
+    /* Share the requests out between the connections. */
+    signal(SIGPIPE, SIG_IGN);
+    int n_connections = options->n_threads < n_requests ? options->n_threads : (n_requests > 0 ? n_requests : 1);
+    ClientConnection *connections = safe_malloc(n_connections * sizeof(ClientConnection));
+    double start = now_seconds();
+    for (int i = 0; i < n_connections; i++) {
+        connections[i].socket_path = options->client_path;
+        connections[i].requests = requests;
+        connections[i].first = (int)((int64_t)n_requests * i / n_connections);
+        connections[i].n_requests = (int)((int64_t)n_requests * (i + 1) / n_connections) - connections[i].first;
+        connections[i].output = NULL;
+        connections[i].output_size = 0;
+        connections[i].failed = false;
+        if (pthread_create(&connections[i].thread, NULL, run_client_connection, &connections[i]) != 0) {
+            perror("Thread creation failed!");
+            exit(EXIT_FAILURE);
+        }
+    }
+    bool failed = false;
+    for (int i = 0; i < n_connections; i++) {
+        pthread_join(connections[i].thread, NULL);
+        failed |= connections[i].failed;
+    }
+    double seconds = now_seconds() - start;
+    for (int i = 0; i < n_connections; i++) {
+        fwrite(connections[i].output, 1, connections[i].output_size, stdout);
+        free(connections[i].output);
+    }
+    fprintf(stderr, "%d request%s in %.3f s (%.0f requests/s) over %d connection%s\n", n_requests,
+            n_requests == 1 ? "" : "s", seconds, seconds > 0 ? n_requests / seconds : 0.0, n_connections,
+            n_connections == 1 ? "" : "s");
+    for (int i = 0; i < n_requests; i++) {
+        free(requests[i]);
+    }
+    free(requests);
+    free(connections);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 
 /* * * * * * * * * * * * * * * * * * * Main * * * * * * * * * * * * * * * * * * * * */
 
-int main() {
-    /* Read input data from user. */
+int main(int argc, char **argv) {
+    Options options = parse_options(argc, argv);
+
+    /* Serve queries over a socket, or send them to a server. */
+    if (options.serve_path) {
+        run_server(&options);
+        return end_run(&options, 0);
+    }
+    if (options.client_path) return run_client(&options);
+
+    /* Benchmark a knowledge base, or generate one. */
+    if (options.bench) return end_run(&options, run_bench(&options));
+    if (options.generate) {
+        generate_kb(stdout, &options.generator);
+        return 0;
+    }
+
+    /* Read input data from a file, or from the user. */
     KnowledgeBase kb;
-    read_input(&kb.facts, &kb.n_facts, &kb.rules, &kb.n_rules);
+    STATS_START(load_start);
+    if (options.input_path) {
+        char error[256];
+        if (!load_kb_file(options.input_path, &kb, error, sizeof(error))) {
+            fprintf(stderr, "%s\n", error);
+            exit(EXIT_FAILURE);
+        }
+    } else {
+        init_symbol_table(&kb.symbols);
+        read_input(&kb.symbols, &kb.facts, &kb.n_facts, &kb.rules, &kb.n_rules);
+        number_atoms_by_name(&kb);
+    }
+    STATS_STOP(TIMER_LOAD, load_start);
 
-    /* Display the input data. */
-    print_knowledge_base(&kb);
+    /* Evaluate many fact sets against the same rules. */
+    if (options.queries_path) {
+        run_queries(&kb, &options);
+        free_knowledge_base(&kb);
+        return end_run(&options, 0);
+    }
 
-    /* Compute and display defᵣ for each rule. */
-    print_separator();
-    printf("Definite programs:\n");
-    for (int i = 0; i < kb.n_rules; i++) {
-        int n_variants;
-        DefiniteProgram *defr_set = defr(kb.rules[i], &n_variants);
-        print_defr(defr_set, n_variants, kb.rules[i]);
-        free_definite_programs(defr_set, n_variants);
+    /* Answer questions about out₁(R,A) without computing all of it. */
+    if (options.credulous || options.skeptical || options.member || options.minimal) {
+        run_questions(&kb, &options);
+        free_knowledge_base(&kb);
+        return end_run(&options, 0);
     }
 
-    /* Compute and display def(R). */
-    Results results;
-    results.def_programs = defR(kb.rules, kb.n_rules, &results.n_def_programs);
-    print_separator();
-    print_def(results.def_programs, results.n_def_programs);
+    /* Maintain out₁(R,A) through updates of the knowledge base. */
+    if (options.updates_path) {
+        run_updates(&kb, &options);
+        free_knowledge_base(&kb);
+        return end_run(&options, 0);
+    }
 
-    /* Compute and display cnsᵈ(R,A). */
-    results.cnsd = cns_star(kb.rules, kb.n_rules, kb.facts, kb.n_facts, &results.n_cnsd_models, &results.cnsd_sizes);
-    print_separator();
-    print_models("cnsᵈ(R,A)", results.cnsd, results.cnsd_sizes, results.n_cnsd_models);
+    /* Count the requested stages without printing them. */
+    if (options.count_only) {
+        run_count(&kb, &options);
+        free_knowledge_base(&kb);
+        return end_run(&options, 0);
+    }
 
-    /* Compute and display out₁(R,A). */
-    results.out1 = out(kb.rules, kb.n_rules, kb.facts, kb.n_facts, &results.n_out1_models, &results.out1_sizes);
-    print_separator();
-    print_models("out₁(R,A)", results.out1, results.out1_sizes, results.n_out1_models);
+    /* Display the input data, clearing the prompts off the screen. */
+    if (options.format == FORMAT_HUMAN) {
+        if (!options.input_path) printf("\x1b[3J\x1b[H\x1b[2J");
+        print_knowledge_base(&kb);
+    }
+    if (options.engine != ENGINE_SOLVER) exit_if_unenumerable(&kb);
+    exit_if_memory_too_small(&kb, &options);
+    ModelWriter output;
+    init_model_writer(&output, stdout, options.format, &kb.symbols);
+
+    /* Compute cnsᵈ(R,A) and out₁(R,A) per component of R, and display their products. */
+    if (options.components) {
+        Decomposition decomposition = solve_components(&kb, &options);
+        STATS_START(output_start);
+        for (int stage = STAGE_CNSD; stage <= STAGE_OUT1; stage <<= 1) {
+            if (!(options.stages & stage)) continue;
+            if (options.format == FORMAT_HUMAN) print_separator();
+            print_model_product(&output, &decomposition, stage);
+            if (options.format == FORMAT_HUMAN) {
+                printf("(product of %d component%s)\n", decomposition.n_components, decomposition.n_components == 1 ? "" : "s");
+            }
+        }
+        free_model_writer(&output);
+        fflush(stdout);
+        STATS_STOP(TIMER_OUTPUT, output_start);
+        free_decomposition(&decomposition);
+        free_knowledge_base(&kb);
+        return end_run(&options, 0);
+    }
+
+    /* Compute defᵣ for each rule once, for all stages, and display it; the solver needs none of it. */
+    CompiledRules compiled;
+    if (options.engine != ENGINE_SOLVER) {
+        STATS_START(compile_start);
+        compiled = compile_rules(kb.rules, kb.n_rules, kb.symbols.n_symbols);
+        if (options.reduce) {
+            ProgramSpaceReduction reduction = reduce_program_space(&compiled, kb.facts, kb.n_facts);
+            print_reduction(&reduction);
+        }
+        STATS_STOP(TIMER_COMPILE, compile_start);
+    }
+    if (options.stages & STAGE_DEF) {
+        print_separator();
+        printf("Definite programs:\n");
+        for (int i = 0; i < kb.n_rules; i++) {
+            print_defr(&output.writer, &kb.symbols, compiled.defrs[i], compiled.n_options[i], kb.rules[i]);
+        }
+        print_separator();
+        printf("def(R) = {\n");
+    }
+
+    /* Compute def(R), cnsᵈ(R,A) and out₁(R,A) in a single pass, or the last two with the
+     * solver, displaying def(R) as it goes, or else the models of the first stage as they
+     * are found. */
+    Stage streamed = 0;
+    if (!(options.stages & STAGE_DEF) && (options.stages & (STAGE_CNSD | STAGE_OUT1))) {
+        streamed = (options.stages & STAGE_CNSD) ? STAGE_CNSD : STAGE_OUT1;
+        if (options.format == FORMAT_HUMAN) print_separator();
+        fflush(stdout);
+        begin_model_set(&output, streamed);
+    }
+    DefPrinter printer = { &kb.symbols, &output.writer, 0 };
+    bool budgeted = options.budget.max_models > 0 || options.budget.time_budget_ms > 0;
+    STATS_START(search_start);
+    Results results;
+    if (options.engine == ENGINE_SOLVER) {
+        results = solve_results(&kb, options.stages, streamed, stream_model, &output);
+    } else {
+        results = compute_results(&compiled, kb.facts, kb.n_facts, options.stages, options.n_threads,
+                                  (options.stages & STAGE_DEF) ? print_def_program : NULL, &printer,
+                                  streamed, stream_model, &output,
+                                  budgeted || options.budget.max_memory > 0 ? &options.budget : NULL);
+    }
+    if (options.stages & STAGE_DEF) {
+        writer_flush(&output.writer);
+        printf("\n}\n");
+    }
+    if (options.engine == ENGINE_CHECK) {
+        Results solved = solve_results(&kb, options.stages & ~STAGE_DEF, 0, NULL, NULL);
+        check_solver_results(&results, &solved, options.stages);
+        free_results(&solved);
+    }
+    STATS_STOP(TIMER_SEARCH, search_start);
+    STATS_START(output_start);
+
+    /* Display cnsᵈ(R,A), then out₁(R,A), unless their models were already streamed;
+     * spilled models are merged from their runs as they are written. */
+    for (Stage stage = STAGE_CNSD; stage <= STAGE_OUT1; stage <<= 1) {
+        if (!(options.stages & stage)) continue;
+        const ModelSet *set = stage == STAGE_CNSD ? &results.cnsd : &results.out1;
+        ModelRuns *runs = stage == STAGE_CNSD ? &results.cnsd_runs : &results.out1_runs;
+        if (stage != streamed) {
+            if (options.format == FORMAT_HUMAN) print_separator();
+            begin_model_set(&output, stage);
+        }
+        if (runs->n_runs > 0) merge_model_runs(runs, stream_model, &output);
+        else if (stage != results.streamed) write_model_set(&output, set);
+        uint64_t n_duplicates = runs->n_runs > 0 ? runs->n_duplicates : set->n_duplicates;
+        end_model_set(&output, n_duplicates);
+        if (options.format == FORMAT_HUMAN && options.engine != ENGINE_SOLVER) print_duplicates(n_duplicates);
+    }
+    free_model_writer(&output);
+    fflush(stdout);
+    STATS_STOP(TIMER_OUTPUT, output_start);
+    if (budgeted) print_coverage(&results, &options);
 
     /* Free all allocated memory. */
-    free_definite_programs(results.def_programs, results.n_def_programs);
-    free_models(results.cnsd, results.cnsd_sizes, results.n_cnsd_models);
-    free_models(results.out1, results.out1_sizes, results.n_out1_models);
+    free_results(&results);
+    if (options.engine != ENGINE_SOLVER) free_compiled_rules(&compiled);
     free_knowledge_base(&kb);
 
-    return 0;
+    return end_run(&options, 0);
 }